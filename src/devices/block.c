@@ -3,7 +3,12 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Number of buckets in a histogram. */
+#define HIST_CNT 8
 
 /* A block device. */
 struct block
@@ -19,8 +24,26 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Requests submitted to this device, by the number of
+       requests pending on the queue that served them, and by
+       timer ticks from submission to completion.  See
+       hist_bucket() for the bucket ranges. */
+    unsigned long long depth_hist[HIST_CNT];
+    unsigned long long latency_hist[HIST_CNT];
+
+    /* Request queue, used if the driver provides TRANSFER.
+       A kernel thread serves the queue. */
+    struct lock queue_lock;             /* Guards the members below. */
+    struct list queue;                  /* Pending requests, by sector. */
+    struct condition queue_ready;       /* Signaled when QUEUE fills. */
+    unsigned queue_depth;               /* Requests queued or in progress. */
+    block_sector_t head_pos;            /* Sector after last transfer. */
   };
 
+/* Most requests that one call to transfer() queues at once. */
+#define REQUESTS_PER_SUBMIT 4
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -28,6 +51,16 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, block_sector_t,
+                      const struct block_iovec *, size_t iov_cnt,
+                      bool write);
+static int hist_bucket (int64_t value);
+static bool request_less (const struct list_elem *, const struct list_elem *,
+                          void *aux);
+static void complete (struct block_request *);
+static void submit_and_wait (struct block *, struct block_request[],
+                             size_t cnt);
+static thread_func queue_thread NO_RETURN;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -99,17 +132,19 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Verifies that the CNT sectors starting at SECTOR are within
+   BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
 {
-  if (sector >= block->size)
+  if (sector >= block->size || cnt > block->size - sector)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
       PANIC ("Access past end of device %s (sector=%"PRDSNu", "
-             "size=%"PRDSNu")\n", block_name (block), sector, block->size);
+             "cnt=%"PRDSNu", size=%"PRDSNu")\n", block_name (block),
+             sector, cnt, block->size);
     }
 }
 
@@ -120,9 +155,8 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  struct block_iovec iov = { buffer, 1 };
+  transfer (block, sector, &iov, 1, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +167,104 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  struct block_iovec iov = { (void *) buffer, 1 };
+  transfer (block, sector, &iov, 1, true);
+}
+
+/* Reads consecutive sectors of BLOCK, starting at SECTOR, into
+   the IOV_CNT buffers in IOV: the first IOV[0].cnt sectors into
+   IOV[0].buffer, the next IOV[1].cnt sectors into IOV[1].buffer,
+   and so on.  The whole range is submitted at once, so that it
+   can be moved in as few commands as possible. */
+void
+block_readv (struct block *block, block_sector_t sector,
+             const struct block_iovec *iov, size_t iov_cnt)
+{
+  transfer (block, sector, iov, iov_cnt, false);
+}
+
+/* Writes consecutive sectors of BLOCK, starting at SECTOR, from
+   the IOV_CNT buffers in IOV, as block_readv() reads them.
+   Returns after the block device has acknowledged receiving all
+   of the data. */
+void
+block_writev (struct block *block, block_sector_t sector,
+              const struct block_iovec *iov, size_t iov_cnt)
+{
+  transfer (block, sector, iov, iov_cnt, true);
+}
+
+/* Starts moving R->cnt sectors between BLOCK, starting at
+   R->sector, and R->buffer, and returns without waiting for the
+   transfer to finish.  When it does, R->complete is called, or,
+   if that is null, block_wait() on R returns.  See the comment
+   on struct block_request in block.h for details.
+
+   On return, R->sector has been translated into a sector on the
+   device that does the work, if BLOCK is a partition.  Requests
+   that are outstanding at the same time must not overlap, since
+   they may be reordered. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  struct block *origin = block;
+
+  ASSERT (r->cnt > 0 && r->cnt <= BLOCK_MAX_TRANSFER);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  sema_init (&r->done, 0);
+  r->origin = origin;
+  r->start = timer_ticks ();
+
+  /* Follow partitions and other remapped devices down to the
+     device that does the work.  Each level counts the sectors
+     moved through it. */
+  for (;;)
+    {
+      check_sectors (block, r->sector, r->cnt);
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+      if (block->ops->remap == NULL)
+        break;
+      block = block->ops->remap (block->aux, &r->sector);
+    }
+
+  if (block->ops->transfer == NULL)
+    {
+      /* No queue.  Move one sector at a time, right away. */
+      uint8_t *buffer = r->buffer;
+      block_sector_t i;
+
+      for (i = 0; i < r->cnt; i++)
+        if (r->write)
+          block->ops->write (block->aux, r->sector + i,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+        else
+          block->ops->read (block->aux, r->sector + i,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+      origin->depth_hist[0]++;
+      origin->latency_hist[hist_bucket (timer_elapsed (r->start))]++;
+      complete (r);
+      return;
+    }
+
+  lock_acquire (&block->queue_lock);
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  block->queue_depth++;
+  origin->depth_hist[hist_bucket (block->queue_depth - 1)]++;
+  cond_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for R, which must have been submitted with a null
+   completion function, to finish. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->complete == NULL);
+  sema_down (&r->done);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,6 +288,47 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Returns the histogram bucket for VALUE: 0 for 0, 1 for 1, 2
+   for 2 or 3, 3 for 4 through 7, and so on, with the last bucket
+   taking everything larger. */
+static int
+hist_bucket (int64_t value)
+{
+  int bucket = 0;
+
+  while (value > 0 && bucket < HIST_CNT - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Prints histogram HIST, labeled TITLE, adding BIAS to the
+   bottom of each bucket's range.  Empty buckets are skipped. */
+static void
+print_hist (const char *title, const unsigned long long hist[HIST_CNT],
+            int bias)
+{
+  int i;
+
+  printf ("  %s:", title);
+  for (i = 0; i < HIST_CNT; i++)
+    if (hist[i] > 0)
+      {
+        int low = (i == 0 ? 0 : 1 << (i - 1)) + bias;
+        int high = (1 << i) - 1 + bias;
+
+        if (i == HIST_CNT - 1)
+          printf (" %d+:%llu", low, hist[i]);
+        else if (low == high)
+          printf (" %d:%llu", low, hist[i]);
+        else
+          printf (" %d-%d:%llu", low, high, hist[i]);
+      }
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -174,6 +343,11 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->read_cnt + block->write_cnt > 0)
+            {
+              print_hist ("queue depth", block->depth_hist, 1);
+              print_hist ("latency (ticks)", block->latency_hist, 0);
+            }
         }
     }
 }
@@ -200,6 +374,13 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  memset (block->depth_hist, 0, sizeof block->depth_hist);
+  memset (block->latency_hist, 0, sizeof block->latency_hist);
+  lock_init (&block->queue_lock);
+  list_init (&block->queue);
+  cond_init (&block->queue_ready);
+  block->queue_depth = 0;
+  block->head_pos = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -208,6 +389,10 @@ block_register (const char *name, enum block_type type,
     printf (", %s", extra_info);
   printf ("\n");
 
+  if (ops->transfer != NULL
+      && thread_create (block->name, PRI_MAX, queue_thread, block) == TID_ERROR)
+    PANIC ("Failed to start queue thread for block device %s", block->name);
+
   return block;
 }
 
@@ -221,3 +406,170 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Request queue. */
+
+/* Returns true if request A is for an earlier sector than
+   request B. */
+static bool
+request_less (const struct list_elem *a, const struct list_elem *b,
+              void *aux UNUSED)
+{
+  return (list_entry (a, struct block_request, elem)->sector
+          < list_entry (b, struct block_request, elem)->sector);
+}
+
+/* Moves the next requests to serve from BLOCK's queue into
+   BATCH.  Requests are served in C-LOOK order: the first request
+   at or after the sector where the last transfer ended, or the
+   lowest one if there is none, so that the disk head sweeps
+   upward and then jumps back.  Following requests in the same
+   direction for the sectors just after it are merged into the
+   same batch, up to BLOCK_MAX_TRANSFER sectors.  Must be called
+   with BLOCK's queue_lock held and its queue not empty. */
+static void
+next_batch (struct block *block, struct list *batch)
+{
+  struct block_request *first, *r;
+  struct list_elem *e;
+  block_sector_t end, cnt;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector
+        >= block->head_pos)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  end = first->sector + first->cnt;
+  cnt = first->cnt;
+  e = list_remove (e);
+  list_init (batch);
+  list_push_back (batch, &first->elem);
+
+  /* The queue is sorted, so merge candidates follow FIRST. */
+  while (e != list_end (&block->queue))
+    {
+      r = list_entry (e, struct block_request, elem);
+      if (r->sector > end)
+        break;
+      if (r->sector == end && r->write == first->write
+          && cnt + r->cnt <= BLOCK_MAX_TRANSFER)
+        {
+          end += r->cnt;
+          cnt += r->cnt;
+          e = list_remove (e);
+          list_push_back (batch, &r->elem);
+        }
+      else
+        e = list_next (e);
+    }
+  block->head_pos = end;
+}
+
+/* Finishes request R by calling its completion function or
+   waking up its waiter.  R may be gone once this returns. */
+static void
+complete (struct block_request *r)
+{
+  if (r->complete != NULL)
+    r->complete (r, r->aux);
+  else
+    sema_up (&r->done);
+}
+
+/* Serves BLOCK's queue: repeatedly passes the next batch of
+   requests to the driver and completes them, sleeping while the
+   queue is empty. */
+static void
+queue_thread (void *block_)
+{
+  struct block *block = block_;
+
+  lock_acquire (&block->queue_lock);
+  for (;;)
+    {
+      struct list batch;
+      struct list_elem *e;
+
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_ready, &block->queue_lock);
+
+      next_batch (block, &batch);
+      lock_release (&block->queue_lock);
+      block->ops->transfer (block->aux, &batch);
+      lock_acquire (&block->queue_lock);
+
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          r->origin->latency_hist[hist_bucket (timer_elapsed (r->start))]++;
+          block->queue_depth--;
+        }
+
+      /* Completion functions may submit more requests, so they
+         must not be called with the queue locked. */
+      lock_release (&block->queue_lock);
+      while (!list_empty (&batch))
+        complete (list_entry (list_pop_front (&batch),
+                              struct block_request, elem));
+      lock_acquire (&block->queue_lock);
+    }
+}
+
+/* Moves consecutive sectors of BLOCK, starting at SECTOR, to or
+   from the IOV_CNT buffers in IOV, and returns when done.  The
+   buffers are split into requests of at most BLOCK_MAX_TRANSFER
+   sectors, and a few at a time are submitted together so that
+   the queue can merge them. */
+static void
+transfer (struct block *block, block_sector_t sector,
+          const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  struct block_request reqs[REQUESTS_PER_SUBMIT];
+  size_t i, req_cnt;
+
+  req_cnt = 0;
+  for (i = 0; i < iov_cnt; i++)
+    {
+      uint8_t *buffer = iov[i].buffer;
+      block_sector_t left = iov[i].cnt;
+
+      while (left > 0)
+        {
+          struct block_request *r = &reqs[req_cnt++];
+
+          r->sector = sector;
+          r->cnt = left < BLOCK_MAX_TRANSFER ? left : BLOCK_MAX_TRANSFER;
+          r->buffer = buffer;
+          r->write = write;
+          r->complete = NULL;
+
+          sector += r->cnt;
+          buffer += r->cnt * BLOCK_SECTOR_SIZE;
+          left -= r->cnt;
+
+          if (req_cnt == REQUESTS_PER_SUBMIT)
+            {
+              submit_and_wait (block, reqs, req_cnt);
+              req_cnt = 0;
+            }
+        }
+    }
+  submit_and_wait (block, reqs, req_cnt);
+}
+
+/* Submits the CNT requests in REQS to BLOCK and waits for all of
+   them to finish. */
+static void
+submit_and_wait (struct block *block, struct block_request reqs[], size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    block_submit (block, &reqs[i]);
+  for (i = 0; i < cnt; i++)
+    block_wait (&reqs[i]);
+}
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -17,6 +19,10 @@ typedef uint32_t block_sector_t;
 /* Format specifier for printf(), e.g.:
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
+
+/* Most sectors moved by a single transfer, the limit of one ATA
+   command. */
+#define BLOCK_MAX_TRANSFER 256
 
 /* Higher-level interface for file systems, etc. */
 
@@ -49,10 +55,58 @@ struct block *block_get_by_name (const char *name);
 struct block *block_first (void);
 struct block *block_next (struct block *);
 
+/* One piece of a vectored transfer: CNT sectors at BUFFER. */
+struct block_iovec
+  {
+    void *buffer;
+    block_sector_t cnt;
+  };
+
+/* Asynchronous I/O.
+
+   A request moves CNT consecutive sectors, at most
+   BLOCK_MAX_TRANSFER, between a block device and BUFFER.  The
+   caller fills in SECTOR, CNT, BUFFER, WRITE, COMPLETE, and AUX,
+   then passes the request to block_submit(), which returns
+   without waiting for the transfer.  When the transfer is done,
+   COMPLETE is called with the request and AUX, or, if COMPLETE
+   is null, the request's semaphore is raised so that
+   block_wait() returns.  The request must stay in place until
+   then.
+
+   Completion functions run in a kernel thread that serves the
+   device's queue.  They may take locks and submit more requests,
+   but must not wait for I/O themselves. */
+struct block_request;
+typedef void block_complete_func (struct block_request *, void *aux);
+
+struct block_request
+  {
+    struct list_elem elem;              /* Element in queue or batch. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* Write, rather than read? */
+    block_complete_func *complete;      /* Called when done, or null. */
+    void *aux;                          /* Passed to COMPLETE. */
+
+    /* Owned by block.c. */
+    struct semaphore done;              /* Up'd when done, if no COMPLETE. */
+    struct block *origin;               /* Device submitted to. */
+    int64_t start;                      /* Timer ticks at submission. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Block device operations. */
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_readv (struct block *, block_sector_t,
+                  const struct block_iovec *, size_t iov_cnt);
+void block_writev (struct block *, block_sector_t,
+                   const struct block_iovec *, size_t iov_cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -61,10 +115,25 @@ void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* A driver provides either READ and WRITE, which move one sector
+   at a time, or TRANSFER.  A device with TRANSFER gets a request
+   queue in block.c, which sorts pending requests in C-LOOK
+   elevator order and merges requests for adjacent sectors.  Each
+   call to TRANSFER is passed a list of requests, all reads or
+   all writes, for consecutive sectors totaling at most
+   BLOCK_MAX_TRANSFER sectors, and moves them all at once.  It
+   is called from the device's queue thread and may sleep.
+
+   A device that is a window onto another, such as a partition,
+   provides only REMAP instead.  It returns the underlying device
+   and translates *SECTOR into a sector on that device, so that
+   requests are queued where they can be merged. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*transfer) (void *aux, struct list *batch);
+    struct block *(*remap) (void *aux, block_sector_t *sector);
   };
 
 struct block *block_register (const char *name, enum block_type,
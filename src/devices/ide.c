@@ -8,7 +8,9 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +32,37 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE registers, found through PCI.  Each channel has
+   its own set, the secondary channel's 8 ports after the
+   primary's. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error; write 1 to clear. */
+#define BM_STA_INT 0x04         /* Interrupt; write 1 to clear. */
+
+/* PCI configuration space, accessed through configuration
+   mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Address port. */
+#define PCI_CONFIG_DATA 0xcfc   /* Data port. */
+#define PCI_REG_ID 0x00         /* Device and vendor IDs. */
+#define PCI_REG_COMMAND 0x04    /* Status and command. */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, interface. */
+#define PCI_REG_BAR4 0x20       /* Base address 4: bus master. */
+#define PCI_CMD_IO 0x01         /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x04     /* Allow bus mastering. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +78,23 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* A physical region descriptor, one entry of the table that
+   tells the bus master where to move data.  A region must not
+   cross a 64 kB boundary; a SIZE of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes. */
+    uint16_t flags;             /* PRD_EOT in the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))  /* Entries in a table. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +103,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 1 if not supported. */
+    bool dma;                   /* Use bus master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +121,10 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, or 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
+    uint8_t bm_status;          /* Bus master status at last interrupt. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -84,8 +137,16 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int max);
+static uint16_t find_bus_master (void);
+static bool build_prdt (struct channel *, struct list *batch);
+static void dma_transfer (struct ata_disk *, struct block_request *first,
+                          block_sector_t cnt);
+static void pio_transfer (struct ata_disk *, struct block_request *first,
+                          block_sector_t cnt);
+
+static void select_sectors (struct ata_disk *, block_sector_t,
+                            block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,8 +162,12 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
+  if (bm_base == 0)
+    printf ("ide: no bus master IDE controller, using PIO\n");
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +191,16 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Set up DMA, if we have a bus master. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0) 
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +211,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 1;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -303,12 +380,98 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Word 47 gives the most sectors the disk can move per
+     interrupt with READ/WRITE MULTIPLE. */
+  set_multiple_mode (d, *(uint16_t *) &id[47 * 2] & 0xff);
+
+  /* Bit 8 of word 49 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+  if (d->dma)
+    printf ("%s: using bus master DMA\n", d->name);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Asks disk D to move MAX sectors per interrupt in READ/WRITE
+   MULTIPLE commands.  If MAX is 0 or 1, or the disk refuses,
+   leaves D using READ/WRITE SECTOR instead. */
+static void
+set_multiple_mode (struct ata_disk *d, int max) 
+{
+  struct channel *c = d->channel;
+
+  if (max <= 1)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = max;
+}
+
+/* Reads the 32-bit register REG from the PCI configuration space
+   of function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) 
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register REG in the PCI
+   configuration space of function FUNC of device DEV on bus
+   BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value) 
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, such as the PIIX emulated by QEMU and Bochs.  If one
+   is found, enables bus mastering and returns the base I/O port
+   of its bus master registers.  Returns 0 otherwise. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4, command;
+
+        if ((pci_read_config (0, dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 1, subclass 1 is an IDE controller.  Bit 7 of the
+           programming interface says it can be a bus master. */
+        class = pci_read_config (0, dev, func, PCI_REG_CLASS);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        /* The bus master registers must be in I/O space. */
+        bar4 = pci_read_config (0, dev, func, PCI_REG_BAR4);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        command = pci_read_config (0, dev, func, PCI_REG_COMMAND);
+        pci_write_config (0, dev, func, PCI_REG_COMMAND,
+                          (command & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +500,191 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Moves the requests in BATCH, which are for consecutive
+   sectors and all reads or all writes, between disk D and their
+   buffers with a single command.  Uses bus master DMA if the disk
+   and controller support it and every buffer can be described
+   to the bus master, and PIO otherwise.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_transfer (void *d_, struct list *batch)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  struct block_request *first;
+  struct list_elem *e;
+  block_sector_t cnt;
+
+  cnt = 0;
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    cnt += list_entry (e, struct block_request, elem)->cnt;
+  first = list_entry (list_front (batch), struct block_request, elem);
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (d->dma && build_prdt (c, batch))
+    dma_transfer (d, first, cnt);
+  else
+    pio_transfer (d, first, cnt);
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Fills C's PRD table with the buffers of the requests in BATCH.
+   Returns false if a buffer is not word-aligned, as the bus
+   master requires, or if the table is too small. */
+static bool
+build_prdt (struct channel *c, struct list *batch) 
+{
+  struct list_elem *e;
+  size_t n = 0;
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uint8_t *buffer = r->buffer;
+      size_t left = r->cnt * BLOCK_SECTOR_SIZE;
+
+      if ((uintptr_t) buffer & 1)
+        return false;
+
+      /* Kernel virtual memory maps physical memory in order, so
+         only the 64 kB boundaries need to be split at. */
+      while (left > 0)
+        {
+          uintptr_t phys = vtop (buffer);
+          size_t size = 0x10000 - (phys & 0xffff);
+          if (size > left)
+            size = left;
+          if (n == PRD_CNT)
+            return false;
+
+          c->prdt[n].addr = phys;
+          c->prdt[n].size = size & 0xffff;
+          c->prdt[n].flags = 0;
+          n++;
+
+          buffer += size;
+          left -= size;
+        }
+    }
+  c->prdt[n - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Moves CNT sectors, starting at FIRST's sector, between disk D
+   and the buffers already described by its channel's PRD table.
+   The calling thread sleeps until the completion interrupt, so
+   the CPU is free for other work during the transfer.  Must be
+   called with the channel lock held. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+dma_transfer (struct ata_disk *d, struct block_request *first,
+              block_sector_t cnt) 
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
+  uint8_t direction = first->write ? 0 : BM_CMD_READ;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INT);
+
+  select_sectors (d, first->sector, cnt);
+  issue_pio_command (c, first->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
   sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  outb (reg_bm_command (c), direction);
+
+  if ((c->bm_status & BM_STA_ERR) != 0
+      || (inb (reg_alt_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu, d->name,
+           first->write ? "write" : "read", first->sector);
+}
+
+/* Moves CNT sectors, starting at FIRST's sector, between disk D
+   and the buffers of FIRST and the requests after it, with the
+   CPU copying each sector through the data register.  Each
+   interrupt moves one sector, or up to D->multiple sectors if
+   the disk supports READ/WRITE MULTIPLE.  Must be called with
+   the channel lock held. */
+static void
+pio_transfer (struct ata_disk *d, struct block_request *first,
+              block_sector_t cnt) 
+{
+  struct channel *c = d->channel;
+  struct block_request *r;
+  block_sector_t done, ofs;
+  uint8_t command;
+
+  if (d->multiple > 1)
+    command = first->write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = first->write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+
+  select_sectors (d, first->sector, cnt);
+  issue_pio_command (c, command);
+
+  /* R and OFS track the next sector's buffer. */
+  r = first;
+  ofs = 0;
+  for (done = 0; done < cnt; )
+    {
+      block_sector_t n = cnt - done;
+      if (n > (block_sector_t) d->multiple)
+        n = d->multiple;
+
+      if (!first->write) 
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, first->sector + done);
+        }
+      else if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, first->sector + done);
+
+      for (; n > 0; n--, done++)
+        {
+          uint8_t *buffer = (uint8_t *) r->buffer + ofs * BLOCK_SECTOR_SIZE;
+          if (first->write)
+            output_sector (c, buffer);
+          else
+            input_sector (c, buffer);
+          if (++ofs == r->cnt && done + 1 < cnt)
+            {
+              r = list_entry (list_next (&r->elem), struct block_request,
+                              elem);
+              ofs = 0;
+            }
+        }
+
+      if (first->write)
+        sema_down (&c->completion_wait);
+    }
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,
+    NULL,
+    ide_transfer,
+    NULL
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.)  A CNT of BLOCK_MAX_TRANSFER is
+   written as 0, which ATA takes to mean 256. */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no,
+                block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= BLOCK_MAX_TRANSFER);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == BLOCK_MAX_TRANSFER ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -513,6 +804,13 @@ interrupt_handler (struct intr_frame *f)
       {
         if (c->expecting_interrupt) 
           {
+            /* Save and clear the bus master's status, which tells
+               the waiter whether a DMA transfer succeeded. */
+            if (c->bm_base != 0) 
+              {
+                c->bm_status = inb (reg_bm_status (c));
+                outb (reg_bm_status (c), c->bm_status);
+              }
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
@@ -14,6 +14,13 @@
 /* PIT cycles per second. */
 #define PIT_HZ 1193180
 
+/* Counter value most recently loaded into each channel, where 0
+   stands for 65536.  Used by pit_elapsed_periods(). */
+static uint16_t channel_count[3];
+
+static uint16_t frequency_to_count (int frequency);
+static void load_channel (int channel, int mode, uint16_t count);
+
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -45,22 +52,94 @@
 void
 pit_configure_channel (int channel, int mode, int frequency)
 {
-  uint16_t count;
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (mode == 2 || mode == 3);
+
+  load_channel (channel, mode, frequency_to_count (frequency));
+}
+
+/* Configures CHANNEL like pit_configure_channel(), except that
+   the period is PERIODS times as long as a FREQUENCY Hz period,
+   or as many periods as fit in the PIT's 16-bit counter if that
+   is fewer.  Returns the number of periods actually programmed,
+   which is at least 1.  Used for dynamic ticks, where the timer
+   is slowed down while there is nothing to do. */
+int
+pit_configure_periods (int channel, int mode, int frequency, int periods)
+{
+  uint16_t count = frequency_to_count (frequency);
+  int max_periods = count != 0 ? 65535 / count : 1;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (mode == 2 || mode == 3);
+  ASSERT (periods >= 1);
+
+  if (periods > max_periods)
+    periods = max_periods;
+  load_channel (channel, mode, count * periods);
+  return periods;
+}
+
+/* Returns the number of whole FREQUENCY Hz periods that have
+   passed since CHANNEL's counter was last loaded, by latching
+   and reading the counter's current value, and stores in
+   *FRACTION the PIT cycles that have passed since the last of
+   them.  Only meaningful before the counter first reaches zero. */
+int
+pit_elapsed_periods (int channel, int frequency, int *fraction)
+{
+  uint32_t loaded = channel_count[channel] != 0 ? channel_count[channel] : 65536;
+  uint16_t count = frequency_to_count (frequency);
+  uint32_t period = count != 0 ? count : 65536;
+  uint32_t current, elapsed;
   enum intr_level old_level;
 
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the counter, then read it low byte first. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  current = inb (PIT_PORT_COUNTER (channel));
+  current |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  elapsed = current != 0 && current <= loaded ? loaded - current : 0;
+  *fraction = elapsed % period;
+  return elapsed / period;
+}
+
+/* Configures CHANNEL like pit_configure_channel(), except that
+   the first period is cut short by FRACTION PIT cycles, so that
+   a period of which FRACTION cycles have already passed can be
+   finished.  The shortened period repeats until the channel is
+   configured again. */
+void
+pit_configure_rest (int channel, int mode, int frequency, int fraction)
+{
+  uint16_t count = frequency_to_count (frequency);
+  int32_t rest = (count != 0 ? count : 65536) - fraction;
+
   ASSERT (channel == 0 || channel == 2);
   ASSERT (mode == 2 || mode == 3);
+  ASSERT (fraction >= 0);
+
+  /* A count of 1 is illegal in mode 2. */
+  load_channel (channel, mode, rest >= 2 ? rest : 2);
+}
 
-  /* Convert FREQUENCY to a PIT counter value.  The PIT has a
-     clock that runs at PIT_HZ cycles per second.  We must
-     translate FREQUENCY into a number of these cycles. */
+/* Converts FREQUENCY to a PIT counter value.  The PIT has a
+   clock that runs at PIT_HZ cycles per second.  We must
+   translate FREQUENCY into a number of these cycles. */
+static uint16_t
+frequency_to_count (int frequency)
+{
   if (frequency < 19)
     {
       /* Frequency is too low: the quotient would overflow the
          16-bit counter.  Force it to 0, which the PIT treats as
          65536, the highest possible count.  This yields a 18.2
          Hz timer, approximately. */
-      count = 0;
+      return 0;
     }
   else if (frequency > PIT_HZ)
     {
@@ -69,15 +148,23 @@ pit_configure_channel (int channel, int mode, int frequency)
          is illegal in mode 2, so we force it to 2, which yields
          a 596.590 kHz timer, approximately.  (This timer rate is
          probably too fast to be useful anyhow.) */
-      count = 2;
+      return 2;
     }
   else
-    count = (PIT_HZ + frequency / 2) / frequency;
+    return (PIT_HZ + frequency / 2) / frequency;
+}
+
+/* Configures the PIT mode of CHANNEL and loads its counter with
+   COUNT. */
+static void
+load_channel (int channel, int mode, uint16_t count)
+{
+  enum intr_level old_level;
 
-  /* Configure the PIT mode and load its counters. */
   old_level = intr_disable ();
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
   outb (PIT_PORT_COUNTER (channel), count);
   outb (PIT_PORT_COUNTER (channel), count >> 8);
+  channel_count[channel] = count;
   intr_set_level (old_level);
 }
@@ -4,5 +4,8 @@
 #include <stdint.h>
 
 void pit_configure_channel (int channel, int mode, int frequency);
+int pit_configure_periods (int channel, int mode, int frequency, int periods);
+int pit_elapsed_periods (int channel, int frequency, int *fraction);
+void pit_configure_rest (int channel, int mode, int frequency, int fraction);
 
 #endif /* devices/pit.h */
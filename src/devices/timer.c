@@ -3,8 +3,10 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -25,14 +27,37 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
-/* The list of sleeping threads */
-static struct list sleeping_threads;
+/* Sleeping threads, kept in a binary min-heap ordered by wakeup
+   tick (sleep_ticks), with ties broken by the order in which the
+   threads went to sleep.  The heap is only touched with
+   interrupts off.  It grows in timer_sleep(), never in the
+   interrupt handler: every sleeper reserves its slot first, under
+   sleep_lock, so that pushing never needs to allocate. */
+static struct thread **sleep_heap;
+static size_t sleep_cnt;        /* # of threads in sleep_heap. */
+static size_t sleep_reserved;   /* # of slots reserved by sleepers. */
+static size_t sleep_cap;        /* # of slots allocated. */
+static unsigned sleep_seq;      /* Tie breaker for equal sleep_ticks. */
+static struct lock sleep_lock;  /* Serializes growing sleep_heap. */
+
+/* Dynamic ticks, enabled by kernel command-line option
+   "-tickless".  While only the idle thread can run, the PIT is
+   slowed down to interrupt at the earliest sleeper's wakeup tick
+   (as far as its 16-bit counter allows) rather than every tick,
+   and ticks is caught up when the idle thread wakes. */
+bool timer_tickless;
+static int stretch_ticks;       /* Ticks the PIT's period covers, or 0
+                                   while it runs at its normal rate. */
 
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void sleep_heap_grow (void);
+static void sleep_heap_push (struct thread *);
+static struct thread *sleep_heap_pop (void);
+static bool sleep_before (const struct thread *, const struct thread *);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -42,7 +67,7 @@ timer_init (void)
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 
-  list_init(&sleeping_threads);
+  lock_init (&sleep_lock);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -95,23 +120,33 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  int64_t start;
+
   /* To account for alarm-negative and alarm-zero */
   if(ticks <= 0) {
     return;
   }
 
-  int64_t start = timer_ticks ();
+  start = timer_ticks ();
 
-  /* Get the total ticks, and add that as the sleeping ticks to the current thread */
-  struct thread* t = thread_current();
-  t->sleep_ticks = ticks + start;
+  /* Reserve a slot in the heap while we are still allowed to
+     allocate */
+  lock_acquire (&sleep_lock);
+  if (sleep_reserved == sleep_cap)
+    sleep_heap_grow ();
+  old_level = intr_disable ();
+  sleep_reserved++;
+  lock_release (&sleep_lock);
 
-  list_insert_ordered(&sleeping_threads, &t->sleep_elem, sleep_order, NULL);
-  //list_entry(list_front(&sleeping_threads), struct thread, sleep_elem);
+  /* Set the wakeup tick and sleep until timer_interrupt() wakes us */
+  t->sleep_ticks = ticks + start;
+  sleep_heap_push (t);
+  thread_block ();
 
-  // list_push_back(&sleeping_threads, &t->sleep_elem);
-  // printf("%s is now sleeping\n", thread_name());
-  sema_down(&t->timer_sema);
+  sleep_reserved--;
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -174,6 +209,67 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  In tickless mode, stretches the PIT period out to the
+   next sleeper's wakeup tick.  The stretch never crosses a second
+   boundary, so that the scheduler's once-a-second work still
+   happens on time. */
+void
+timer_idle_enter (void)
+{
+  int64_t wait;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless)
+    return;
+
+  wait = TIMER_FREQ - ticks % TIMER_FREQ;
+  if (sleep_cnt > 0 && sleep_heap[0]->sleep_ticks - ticks < wait)
+    wait = sleep_heap[0]->sleep_ticks - ticks;
+
+  /* Don't stretch while the PIT is finishing a tick that
+     timer_idle_exit() cut short. */
+  if (wait > 1 && stretch_ticks == 0)
+    {
+      stretch_ticks = pit_configure_periods (0, 2, TIMER_FREQ, wait);
+      if (stretch_ticks == 1)
+        stretch_ticks = 0;
+    }
+}
+
+/* Called by the idle thread, with interrupts off, after it wakes
+   from a halt.  If something other than the timer woke it in the
+   middle of a stretch, accounts for the whole ticks that passed
+   and lets the PIT finish the tick under way, at the end of which
+   timer_interrupt() puts it back to its normal rate. */
+void
+timer_idle_exit (void)
+{
+  int elapsed, fraction;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (stretch_ticks <= 1)
+    return;
+
+  /* Read the counter before checking for a pending timer
+     interrupt.  If the stretch ran out in the meantime, the
+     counter has already reloaded, but the interrupt is pending
+     and timer_interrupt() will account for the whole stretch. */
+  elapsed = pit_elapsed_periods (0, TIMER_FREQ, &fraction);
+  if (intr_ext_pending (0x20))
+    return;
+
+  /* Finish the current tick instead of starting a new one, so
+     that the part of it that has already passed is not lost. */
+  pit_configure_rest (0, 2, TIMER_FREQ, fraction);
+  stretch_ticks = 1;
+
+  ticks += elapsed;
+  thread_skip_ticks (elapsed);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -181,43 +277,117 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Wakes every thread whose wakeup
+   tick has arrived in one pass, then makes a single decision
+   about whether to preempt the running thread. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  struct thread* t;
+  int max_priority = PRI_MIN - 1;
+
+  /* End a tickless stretch, catching up the ticks it covered. */
+  if (stretch_ticks > 0)
+    {
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      ticks += stretch_ticks - 1;
+      thread_skip_ticks (stretch_ticks - 1);
+      stretch_ticks = 0;
+    }
+
   ticks++;
   thread_tick ();
 
-  /* Check if a thread is ready to wake up (unordered version) */
-  // struct list_elem *cnt = list_begin(&sleeping_threads);
-  // while(cnt != list_end(&sleeping_threads)) {
-  //   struct thread* t = list_entry(cnt, struct thread, sleep_elem);
-  //   // While loop to account for multiple threads waking up at the same
-  //   if(ticks >= t->sleep_ticks) {
-  //     // printf("%s is now waking up\n", thread_name());
-  //       sema_up(&t->timer_sema);
-  //       cnt = list_remove(cnt);    
-  //   }
-  //   else {
-  //     cnt = list_next(cnt);
-  //     break; // Exit inner while loop
-  //   }
-    
-  // }
-
-  // While loop to account for multiple threads waking up on the same tick (ordered version)
-  while(!list_empty(&sleeping_threads)) {
-    t = list_entry(list_front(&sleeping_threads), struct thread, sleep_elem);
-    if(ticks >= t->sleep_ticks) {
-      sema_up(&t->timer_sema);
-      list_pop_front(&sleeping_threads);
+  while (sleep_cnt > 0 && sleep_heap[0]->sleep_ticks <= ticks)
+    {
+      struct thread *t = sleep_heap_pop ();
+      thread_unblock (t);
+      if (t->priority > max_priority)
+        max_priority = t->priority;
     }
-    else {
-      break;
+
+  if (max_priority > thread_current ()->priority)
+    intr_yield_on_return ();
+}
+
+/* Doubles the capacity of sleep_heap.  Must be called with
+   sleep_lock held and interrupts on. */
+static void
+sleep_heap_grow (void)
+{
+  size_t new_cap = sleep_cap > 0 ? sleep_cap * 2 : 64;
+  struct thread **new_heap, **old_heap;
+  enum intr_level old_level;
+
+  ASSERT (lock_held_by_current_thread (&sleep_lock));
+
+  new_heap = malloc (new_cap * sizeof *new_heap);
+  if (new_heap == NULL)
+    PANIC ("out of memory for sleeping threads");
+
+  old_level = intr_disable ();
+  memcpy (new_heap, sleep_heap, sleep_cnt * sizeof *sleep_heap);
+  old_heap = sleep_heap;
+  sleep_heap = new_heap;
+  sleep_cap = new_cap;
+  intr_set_level (old_level);
+
+  free (old_heap);
+}
+
+/* Adds T, whose sleep_ticks is set, to sleep_heap.  A slot must
+   already be reserved.  Interrupts must be off. */
+static void
+sleep_heap_push (struct thread *t)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleep_cnt < sleep_cap);
+
+  t->sleep_seq = sleep_seq++;
+  for (i = sleep_cnt++; i > 0; i = (i - 1) / 2)
+    {
+      struct thread *parent = sleep_heap[(i - 1) / 2];
+      if (!sleep_before (t, parent))
+        break;
+      sleep_heap[i] = parent;
     }
-  }
+  sleep_heap[i] = t;
+}
+
+/* Removes and returns the thread with the earliest wakeup tick.
+   The heap must not be empty.  Interrupts must be off. */
+static struct thread *
+sleep_heap_pop (void)
+{
+  struct thread *min, *last;
+  size_t i, child;
 
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleep_cnt > 0);
+
+  min = sleep_heap[0];
+  last = sleep_heap[--sleep_cnt];
+  for (i = 0; (child = 2 * i + 1) < sleep_cnt; i = child)
+    {
+      if (child + 1 < sleep_cnt
+          && sleep_before (sleep_heap[child + 1], sleep_heap[child]))
+        child++;
+      if (!sleep_before (sleep_heap[child], last))
+        break;
+      sleep_heap[i] = sleep_heap[child];
+    }
+  sleep_heap[i] = last;
+  return min;
+}
+
+/* Returns true if sleeping thread A should wake up before B. */
+static bool
+sleep_before (const struct thread *a, const struct thread *b)
+{
+  if (a->sleep_ticks != b->sleep_ticks)
+    return a->sleep_ticks < b->sleep_ticks;
+  return (int) (a->sleep_seq - b->sleep_seq) < 0;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -0,0 +1,450 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* Buffer cache for sectors of the file system device.
+
+   Every sector the file system reads or writes passes through
+   a fixed set of CACHE_SIZE entries.  Writes only dirty the
+   cached copy; a dirty sector reaches the disk when its entry is
+   evicted or when cache_flush() is called.  Entries are chosen
+   for eviction with the clock algorithm.
+
+   A single lock, cache_lock, protects the whole table.  It is
+   held while copying to or from a cached sector, which is cheap,
+   but never across disk I/O.  An entry that is being read from
+   or written back to disk is marked busy; threads that want it
+   wait on io_done until the transfer finishes.
+
+   Read-ahead and cache_flush() submit their transfers without
+   waiting for each one, so read-ahead overlaps with the caller's
+   work and flushed sectors reach the device queue together.
+
+   Sectors written with cache_write_meta() or
+   cache_write_meta_at() hold metadata, which must go through the
+   journal (see journal.c).  A dirty metadata sector is never
+   evicted; it only reaches the disk when it is committed, which
+   cache_flush() does between file system operations.  Only when
+   every entry holds dirty metadata does get_entry() commit
+   without waiting for the open operations to end, since they
+   may be waiting for room in the cache themselves. */
+
+/* Number of sectors in the cache. */
+#define CACHE_SIZE 64
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector held, if valid. */
+    bool valid;                         /* Holds a sector? */
+    bool dirty;                         /* Modified since read? */
+    bool accessed;                      /* Used since last clock pass? */
+    bool busy;                          /* Disk I/O in progress? */
+    block_sector_t flush_sector;        /* Sector being written back,
+                                           if busy and flushing. */
+    bool flushing;                      /* Writing back flush_sector? */
+    bool meta;                          /* Holds metadata? */
+    struct block_request req;           /* Asynchronous transfer. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;          /* Protects everything above. */
+static struct condition io_done;        /* Signaled when I/O ends. */
+static size_t clock_hand;               /* Next entry to consider. */
+static struct lock commit_lock;         /* Serializes commit(). */
+
+static block_complete_func readahead_done;
+static void write_at (block_sector_t, const void *, int ofs, int size,
+                      bool meta);
+static void commit (bool between_ops);
+static void write_all (struct cache_entry *[], size_t cnt);
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *get_entry (block_sector_t, bool load);
+static struct cache_entry *choose_victim (void);
+static size_t dirty_meta_cnt (void);
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  lock_init (&cache_lock);
+  cond_init (&io_done);
+  lock_init (&commit_lock);
+}
+
+/* Writes every dirty sector in the cache to disk, once no file
+   system operation is open, committing the metadata among them
+   as one journal transaction.  Must not be called with an
+   operation open. */
+void
+cache_flush (void)
+{
+  commit (true);
+}
+
+/* Returns true if dirty metadata fills at least half of the
+   cache, so that it should be committed before another operation
+   adds to it. */
+bool
+cache_should_commit (void)
+{
+  size_t cnt;
+
+  lock_acquire (&cache_lock);
+  cnt = dirty_meta_cnt ();
+  lock_release (&cache_lock);
+  return cnt >= CACHE_SIZE / 2;
+}
+
+/* Writes every dirty sector in the cache to disk, committing the
+   metadata among them as one journal transaction.  If
+   BETWEEN_OPS is true, first waits until no file system
+   operation is open, and keeps new ones from beginning until the
+   transaction is gathered.  File data is written in place first,
+   then the metadata to the journal, then the metadata in place.
+   All of the writes in each step are submitted before waiting
+   for any of them, so that the device queue can sort them and
+   merge runs of consecutive sectors. */
+static void
+commit (bool between_ops)
+{
+  struct cache_entry *data[CACHE_SIZE], *meta[CACHE_SIZE];
+  block_sector_t meta_sectors[CACHE_SIZE];
+  void *meta_buffers[CACHE_SIZE];
+  size_t data_cnt = 0, meta_cnt = 0;
+  size_t i;
+
+  if (between_ops)
+    journal_freeze ();
+  lock_acquire (&commit_lock);
+
+  /* Mark the dirty entries busy so that nobody changes them
+     while they are written out. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      while (e->busy)
+        cond_wait (&io_done, &cache_lock);
+      if (e->valid && e->dirty)
+        {
+          e->busy = true;
+          e->dirty = false;
+          if (e->meta)
+            {
+              meta_sectors[meta_cnt] = e->sector;
+              meta_buffers[meta_cnt] = e->data;
+              meta[meta_cnt++] = e;
+            }
+          else
+            data[data_cnt++] = e;
+        }
+    }
+  lock_release (&cache_lock);
+  if (between_ops)
+    journal_thaw ();
+
+  write_all (data, data_cnt);
+  if (meta_cnt > 0)
+    {
+      ASSERT (meta_cnt <= JOURNAL_MAX);
+      journal_commit (meta_cnt, meta_sectors, meta_buffers);
+      write_all (meta, meta_cnt);
+      journal_checkpoint ();
+    }
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < data_cnt; i++)
+    data[i]->busy = false;
+  for (i = 0; i < meta_cnt; i++)
+    meta[i]->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+  lock_release (&cache_lock);
+
+  lock_release (&commit_lock);
+}
+
+/* Writes the CNT entries in ENTRIES, which the caller has marked
+   busy, to their sectors, and waits for all of the writes. */
+static void
+write_all (struct cache_entry *entries[], size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct block_request *r = &entries[i]->req;
+
+      r->sector = entries[i]->sector;
+      r->cnt = 1;
+      r->buffer = entries[i]->data;
+      r->write = true;
+      r->complete = NULL;
+      block_submit (fs_device, r);
+    }
+  for (i = 0; i < cnt; i++)
+    block_wait (&entries[i]->req);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector
+   SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, false);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes of metadata from BUFFER to
+   sector SECTOR. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer)
+{
+  write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, true);
+}
+
+/* Reads SIZE bytes starting at byte OFS within sector SECTOR
+   into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER into sector SECTOR, starting at
+   byte OFS within the sector.  The sector is only read from disk
+   first if the write does not cover all of it. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                int ofs, int size)
+{
+  write_at (sector, buffer, ofs, size, false);
+}
+
+/* Like cache_write_at(), but for metadata. */
+void
+cache_write_meta_at (block_sector_t sector, const void *buffer,
+                     int ofs, int size)
+{
+  write_at (sector, buffer, ofs, size, true);
+}
+
+/* Writes SIZE bytes from BUFFER into sector SECTOR, starting at
+   byte OFS within the sector, and records whether the sector
+   now holds metadata, according to META. */
+static void
+write_at (block_sector_t sector, const void *buffer, int ofs, int size,
+          bool meta)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  e->meta = meta;
+  lock_release (&cache_lock);
+}
+
+/* Starts bringing SECTOR into the cache in the background.
+   Does nothing if SECTOR is already cached, or if making room
+   for it would mean waiting, either for a busy entry or to write
+   back a dirty one. */
+void
+cache_readahead (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  if (lookup (sector) != NULL)
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+  e = choose_victim ();
+  if (e == NULL || (e->valid && e->dirty))
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+
+  /* Claim the entry, as get_entry() does. */
+  e->busy = true;
+  e->flushing = false;
+  e->sector = sector;
+  e->valid = true;
+  e->dirty = false;
+  e->meta = false;
+  e->accessed = true;
+  lock_release (&cache_lock);
+
+  e->req.sector = sector;
+  e->req.cnt = 1;
+  e->req.buffer = e->data;
+  e->req.write = false;
+  e->req.complete = readahead_done;
+  e->req.aux = e;
+  block_submit (fs_device, &e->req);
+}
+
+/* Called when a read started by cache_readahead() finishes, to
+   let threads waiting for entry E_ use it. */
+static void
+readahead_done (struct block_request *r UNUSED, void *e_)
+{
+  struct cache_entry *e = e_;
+
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry that holds SECTOR, or a null pointer if
+   there is none.  An entry whose old contents are still being
+   written back counts as holding its old sector too, so that
+   nobody reads that sector from disk before the write ends.
+   Must be called with cache_lock held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      if ((e->valid && e->sector == sector)
+          || (e->flushing && e->flush_sector == sector))
+        return e;
+    }
+  return NULL;
+}
+
+/* Returns the entry that holds SECTOR, bringing it into the
+   cache if necessary.  If LOAD is false, the caller is about to
+   overwrite the whole sector, so a newly allocated entry is not
+   read from disk.  Must be called with cache_lock held; it is
+   released and reacquired around any disk I/O. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          if (e->busy)
+            {
+              cond_wait (&io_done, &cache_lock);
+              continue;
+            }
+          e->accessed = true;
+          return e;
+        }
+
+      e = choose_victim ();
+      if (e != NULL)
+        break;
+
+      /* Every entry is busy or holds dirty metadata.  Commit the
+         metadata, if there is any, so that its entries can be
+         reused; otherwise wait for one to come free.  The commit
+         cannot wait for open operations to end, because they may
+         need an entry to do so. */
+      if (dirty_meta_cnt () > 0)
+        {
+          lock_release (&cache_lock);
+          commit (false);
+          lock_acquire (&cache_lock);
+        }
+      else
+        cond_wait (&io_done, &cache_lock);
+    }
+
+  /* Claim the entry for SECTOR right away, so that other threads
+     looking for it wait for us instead of loading it again. */
+  e->busy = true;
+  e->flushing = e->valid && e->dirty;
+  e->flush_sector = e->sector;
+  e->sector = sector;
+  e->valid = true;
+  e->dirty = false;
+  e->meta = false;
+  e->accessed = true;
+
+  lock_release (&cache_lock);
+  if (e->flushing)
+    block_write (fs_device, e->flush_sector, e->data);
+  if (load)
+    block_read (fs_device, sector, e->data);
+  lock_acquire (&cache_lock);
+
+  e->flushing = false;
+  e->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+  return e;
+}
+
+/* Returns the number of entries that hold dirty metadata that is
+   not being written yet.  Must be called with cache_lock held. */
+static size_t
+dirty_meta_cnt (void)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (!cache[i].busy && cache[i].valid && cache[i].dirty && cache[i].meta)
+      cnt++;
+  return cnt;
+}
+
+/* Picks an entry to hold a new sector using the clock
+   algorithm, skipping entries with I/O in progress and entries
+   with dirty metadata, which may only be written by a commit.
+   Returns a null pointer if there is no other entry.  Must be
+   called with cache_lock held. */
+static struct cache_entry *
+choose_victim (void)
+{
+  size_t i;
+
+  /* Two trips around the clock clear every accessed bit, so if
+     nothing is found by then, everything is busy. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->busy || (e->valid && e->dirty && e->meta))
+        continue;
+      if (!e->valid || !e->accessed)
+        return e;
+      e->accessed = false;
+    }
+  return NULL;
+}
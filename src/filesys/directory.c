@@ -1,10 +1,16 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
-#include <list.h>
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -13,6 +19,13 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
+/* Guards the contents of directories.  Lookups and listings hold
+   it for reading, so they run concurrently; adding and removing
+   entries hold it for writing, so that checking for a name and
+   claiming a slot happen atomically.  The file system has only a
+   root directory, so one lock covers every directory. */
+static struct rwlock dir_rwlock;
+
 /* A single directory entry. */
 struct dir_entry 
   {
@@ -21,12 +34,122 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Entry 0 of every directory never names a file.  It holds
+   this header instead. */
+struct dir_header
+  {
+    block_sector_t index_sector;        /* Inode of hash index, or 0. */
+    uint32_t free_entry;                /* First free entry, or 0. */
+    uint8_t unused[sizeof (struct dir_entry) - 2 * sizeof (uint32_t)];
+  };
+
+/* On-disk hash index.
+
+   A directory that grows to INDEX_MIN entries gets a hash index,
+   a separate file that is an open-addressed hash table of
+   index_slots mapping the hash of each name in the directory to
+   the number of its entry.  Its size is a power of 2 slots.  A
+   name is always placed within INDEX_WINDOW slots of the slot
+   its hash selects, so a lookup reads at most that many slots,
+   all usually in one sector; if an insertion finds no room
+   there, the index is rebuilt at twice the size.
+
+   So that adding an entry to an indexed directory does not scan
+   for a free one either, its free entries are chained together
+   through their inode_sector members, starting from the
+   header's free_entry.  An entry is taken from the chain, or
+   appended if the chain is empty, and removing one puts it back.
+
+   Removing an entry also turns its index slot into a tombstone,
+   which later insertions reuse. */
+#define INDEX_MIN 64
+#define INDEX_WINDOW 16
+
+/* Values of index_slot's entry member besides entry numbers,
+   which start at 1. */
+#define INDEX_EMPTY 0                   /* Never used. */
+#define INDEX_DELETED UINT32_MAX        /* Entry removed. */
+
+/* A slot in a hash index. */
+struct index_slot
+  {
+    uint32_t hash;                      /* hash_string() of name. */
+    uint32_t entry;                     /* Entry number in directory. */
+  };
+
+/* Dentry cache.
+
+   Remembers, for the most recently looked up names, whether the
+   name exists in its directory and, if so, where its entry is
+   and which inode it names, so that repeated lookups of the same
+   name, including names that do not exist, need no directory
+   reads at all.  Holds at most DENTRY_MAX entries; the least
+   recently used one is dropped to make room for another.
+   dir_add() and dir_remove() invalidate the names they change.
+
+   Lookups fill the cache while holding dir_rwlock only for
+   reading, so it has its own lock. */
+#define DENTRY_MAX 256
+
+/* A cached name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in dentry_lru. */
+    block_sector_t dir_sector;          /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up. */
+    off_t ofs;                          /* Offset of entry, or -1 if
+                                           the name does not exist. */
+    block_sector_t inode_sector;        /* Inode named, if it exists. */
+  };
+
+static struct hash dentries;            /* All cached names. */
+static struct list dentry_lru;          /* Most recently used first. */
+static struct lock dentry_lock;         /* Protects the above. */
+static struct slab_cache dentry_cache;  /* Allocates dentries. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static bool dentry_find (block_sector_t dir_sector, const char *name,
+                         struct dir_entry *, off_t *ofsp);
+static void dentry_insert (block_sector_t dir_sector, const char *name,
+                           const struct dir_entry *, off_t ofs);
+static void dentry_invalidate (block_sector_t dir_sector, const char *name);
+
+static struct inode *index_open (struct inode *dir_inode);
+static bool index_lookup (struct inode *dir_inode, struct inode *index,
+                          const char *name, struct dir_entry *,
+                          off_t *ofsp);
+static bool index_insert (struct inode *index, uint32_t hash,
+                          uint32_t entry);
+static void index_delete (struct inode *index, uint32_t hash,
+                          uint32_t entry);
+static bool index_build (struct inode *dir_inode, size_t slot_cnt);
+static uint32_t chain_free_entries (struct inode *dir_inode);
+static void index_set (struct inode *dir_inode, block_sector_t sector,
+                       uint32_t free_entry);
+static bool read_header (struct inode *dir_inode, struct dir_header *);
+static void write_header (struct inode *dir_inode, const struct dir_header *);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  rwlock_init (&dir_rwlock);
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&dentry_lru);
+  lock_init (&dentry_lock);
+  slab_cache_init (&dentry_cache, "dentry", sizeof (struct dentry), NULL);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  /* Leave room for entry 0 too.  It starts out all zeros, which
+     means that there is no index. */
+  return inode_create (sector, (entry_cnt + 1) * sizeof (struct dir_entry));
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -37,6 +160,7 @@ dir_open (struct inode *inode)
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
     {
+      inode_set_metadata (inode);
       dir->inode = inode;
       dir->pos = 0;
       return dir;
@@ -87,28 +211,61 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+
+   Tries the dentry cache first, then DIR's hash index if it has
+   one, and only then scans every entry.  Remembers the result
+   in the dentry cache. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  block_sector_t dir_sector;
   struct dir_entry e;
-  size_t ofs;
+  struct inode *index;
+  off_t ofs;
+  bool found = false;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  /* No entry can have a longer name. */
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  dir_sector = inode_get_inumber (dir->inode);
+  if (dentry_find (dir_sector, name, &e, &ofs))
+    found = ofs >= 0;
+  else
+    {
+      index = index_open (dir->inode);
+      if (index != NULL)
+        {
+          found = index_lookup (dir->inode, index, name, &e, &ofs);
+          inode_close (index);
+        }
+      else
+        {
+          for (ofs = sizeof e;
+               inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+               ofs += sizeof e) 
+            if (e.in_use && !strcmp (name, e.name)) 
+              {
+                found = true;
+                break;
+              }
+        }
+      dentry_insert (dir_sector, name, &e, found ? ofs : -1);
+    }
+
+  if (found)
+    {
+      if (ep != NULL)
+        *ep = e;
+      if (ofsp != NULL)
+        *ofsp = ofs;
+    }
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -124,10 +281,12 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rwlock_acquire_read (&dir_rwlock);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  rwlock_release_read (&dir_rwlock);
 
   return *inode != NULL;
 }
@@ -142,6 +301,8 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  struct dir_header h;
+  struct inode *index = NULL;
   off_t ofs;
   bool success = false;
 
@@ -152,29 +313,74 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  journal_begin ();
+  rwlock_acquire_write (&dir_rwlock);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
+     current end-of-file.  An indexed directory takes the first
+     entry on its free chain instead of scanning.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  index = index_open (dir->inode);
+  if (index != NULL)
+    {
+      read_header (dir->inode, &h);
+      if (h.free_entry != 0)
+        ofs = h.free_entry * sizeof e;
+      else
+        ofs = inode_length (dir->inode);
+    }
+  else
+    for (ofs = sizeof e;
+         inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e) 
+      if (!e.in_use)
+        break;
 
-  /* Write slot. */
+  /* Write slot, taking it off the free chain first if it is on
+     it. */
+  if (index != NULL && h.free_entry != 0)
+    {
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        goto done;
+      ASSERT (!e.in_use);
+      h.free_entry = e.inode_sector;
+      write_header (dir->inode, &h);
+    }
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  dentry_invalidate (inode_get_inumber (dir->inode), name);
+
+  /* Index the new entry, rebuilding the index bigger if there is
+     no room for it.  If that fails, drop the index, since lookups
+     would miss the entry, and go back to scanning.  A directory
+     that has grown big enough gets its first index. */
+  if (success)
+    {
+      if (index != NULL)
+        {
+          size_t slot_cnt = inode_length (index) / sizeof (struct index_slot);
+          if (!index_insert (index, hash_string (name), ofs / sizeof e)
+              && !index_build (dir->inode, 2 * slot_cnt))
+            index_set (dir->inode, 0, 0);
+        }
+      else if (inode_length (dir->inode) / sizeof e >= INDEX_MIN)
+        index_build (dir->inode, 2 * INDEX_MIN);
+    }
 
  done:
+  rwlock_release_write (&dir_rwlock);
+  inode_close (index);
+  journal_end ();
   return success;
 }
 
@@ -185,13 +391,18 @@ bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
+  struct dir_header h;
   struct inode *inode = NULL;
+  struct inode *index;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  journal_begin ();
+  rwlock_acquire_write (&dir_rwlock);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -201,17 +412,36 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry.  In an indexed directory, put it on
+     the free chain and remove it from the index. */
+  index = index_open (dir->inode);
+  if (index != NULL)
+    read_header (dir->inode, &h);
   e.in_use = false;
+  if (index != NULL)
+    e.inode_sector = h.free_entry;
+  dentry_invalidate (inode_get_inumber (dir->inode), name);
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+    {
+      inode_close (index);
+      goto done;
+    }
+  if (index != NULL)
+    {
+      h.free_entry = ofs / sizeof e;
+      write_header (dir->inode, &h);
+      index_delete (index, hash_string (name), ofs / sizeof e);
+      inode_close (index);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  rwlock_release_write (&dir_rwlock);
   inode_close (inode);
+  journal_end ();
   return success;
 }
 
@@ -222,15 +452,361 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  rwlock_acquire_read (&dir_rwlock);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
+  rwlock_release_read (&dir_rwlock);
+  return found;
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir_sector);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir_sector != b->dir_sector)
+    return a->dir_sector < b->dir_sector;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached dentry for NAME in the directory whose
+   inode is in DIR_SECTOR, or a null pointer if there is none.
+   Must be called with dentry_lock held. */
+static struct dentry *
+dentry_lookup (block_sector_t dir_sector, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.dir_sector = dir_sector;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in DIR_SECTOR in
+   the dentry cache.  Returns false if it is not cached.
+   Otherwise, returns true and sets *OFSP to the offset of NAME's
+   entry and *EP to the entry itself, or *OFSP to -1 if the
+   directory has no entry for NAME. */
+static bool
+dentry_find (block_sector_t dir_sector, const char *name,
+             struct dir_entry *ep, off_t *ofsp)
+{
+  struct dentry *d;
+
+  lock_acquire (&dentry_lock);
+  d = dentry_lookup (dir_sector, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&dentry_lru, &d->lru_elem);
+      *ofsp = d->ofs;
+      ep->inode_sector = d->inode_sector;
+      strlcpy (ep->name, d->name, sizeof ep->name);
+      ep->in_use = true;
+    }
+  lock_release (&dentry_lock);
+  return d != NULL;
+}
+
+/* Records in the dentry cache that NAME's entry in the directory
+   whose inode is in DIR_SECTOR is at OFS and holds E, or, if OFS
+   is -1, that the directory has no entry for NAME. */
+static void
+dentry_insert (block_sector_t dir_sector, const char *name,
+               const struct dir_entry *e, off_t ofs)
+{
+  struct dentry *d;
+
+  lock_acquire (&dentry_lock);
+
+  /* Another reader may have just cached the same name. */
+  if (dentry_lookup (dir_sector, name) != NULL)
+    goto done;
+
+  if (hash_size (&dentries) >= DENTRY_MAX)
+    {
+      d = list_entry (list_pop_back (&dentry_lru), struct dentry, lru_elem);
+      hash_delete (&dentries, &d->hash_elem);
+    }
+  else
+    {
+      d = slab_alloc (&dentry_cache);
+      if (d == NULL)
+        goto done;
+    }
+
+  d->dir_sector = dir_sector;
+  strlcpy (d->name, name, sizeof d->name);
+  d->ofs = ofs;
+  d->inode_sector = ofs >= 0 ? e->inode_sector : 0;
+  hash_insert (&dentries, &d->hash_elem);
+  list_push_front (&dentry_lru, &d->lru_elem);
+
+ done:
+  lock_release (&dentry_lock);
+}
+
+/* Forgets whatever the dentry cache knows about NAME in the
+   directory whose inode is in DIR_SECTOR. */
+static void
+dentry_invalidate (block_sector_t dir_sector, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dentry_lock);
+  d = dentry_lookup (dir_sector, name);
+  if (d != NULL)
+    {
+      hash_delete (&dentries, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      slab_free (&dentry_cache, d);
+    }
+  lock_release (&dentry_lock);
+}
+
+/* Opens and returns the hash index of the directory in
+   DIR_INODE, or returns a null pointer if it has none or it
+   cannot be opened. */
+static struct inode *
+index_open (struct inode *dir_inode)
+{
+  struct inode *index;
+  struct dir_header h;
+
+  if (!read_header (dir_inode, &h) || h.index_sector == 0)
+    return NULL;
+  index = inode_open (h.index_sector);
+  if (index != NULL)
+    inode_set_metadata (index);
+  return index;
+}
+
+/* Reads slot SLOT of hash INDEX into *S.  Returns false if it
+   cannot be read. */
+static bool
+read_slot (struct inode *index, size_t slot, struct index_slot *s)
+{
+  return inode_read_at (index, s, sizeof *s, slot * sizeof *s) == sizeof *s;
+}
+
+/* Writes *S to slot SLOT of hash INDEX.  Returns false if it
+   cannot be written. */
+static bool
+write_slot (struct inode *index, size_t slot, const struct index_slot *s)
+{
+  return inode_write_at (index, s, sizeof *s, slot * sizeof *s) == sizeof *s;
+}
+
+/* Looks up NAME through INDEX, the hash index of the directory
+   in DIR_INODE.  Behaves like lookup() otherwise. */
+static bool
+index_lookup (struct inode *dir_inode, struct inode *index,
+              const char *name, struct dir_entry *ep, off_t *ofsp)
+{
+  size_t slot_cnt = inode_length (index) / sizeof (struct index_slot);
+  uint32_t hash = hash_string (name);
+  size_t i;
+
+  /* Insertions take the first free slot, so a name cannot be
+     past a slot that was never used. */
+  for (i = 0; i < INDEX_WINDOW && i < slot_cnt; i++)
+    {
+      struct index_slot s;
+
+      if (!read_slot (index, (hash + i) & (slot_cnt - 1), &s)
+          || s.entry == INDEX_EMPTY)
+        break;
+      if (s.entry != INDEX_DELETED && s.hash == hash)
+        {
+          *ofsp = s.entry * sizeof *ep;
+          if (inode_read_at (dir_inode, ep, sizeof *ep, *ofsp) == sizeof *ep
+              && ep->in_use && !strcmp (name, ep->name))
+            return true;
+        }
+    }
+  return false;
+}
+
+/* Records in INDEX that the name with hash HASH is in entry
+   ENTRY.  Returns false if there is no free slot close enough
+   to where HASH belongs, or on a disk error. */
+static bool
+index_insert (struct inode *index, uint32_t hash, uint32_t entry)
+{
+  size_t slot_cnt = inode_length (index) / sizeof (struct index_slot);
+  size_t i;
+
+  for (i = 0; i < INDEX_WINDOW && i < slot_cnt; i++)
+    {
+      size_t slot = (hash + i) & (slot_cnt - 1);
+      struct index_slot s;
+
+      if (!read_slot (index, slot, &s))
+        return false;
+      if (s.entry == INDEX_EMPTY || s.entry == INDEX_DELETED)
+        {
+          s.hash = hash;
+          s.entry = entry;
+          return write_slot (index, slot, &s);
+        }
+    }
   return false;
 }
+
+/* Turns the slot of INDEX that refers to entry ENTRY, whose name
+   has hash HASH, into a tombstone. */
+static void
+index_delete (struct inode *index, uint32_t hash, uint32_t entry)
+{
+  size_t slot_cnt = inode_length (index) / sizeof (struct index_slot);
+  size_t i;
+
+  for (i = 0; i < INDEX_WINDOW && i < slot_cnt; i++)
+    {
+      size_t slot = (hash + i) & (slot_cnt - 1);
+      struct index_slot s;
+
+      if (!read_slot (index, slot, &s) || s.entry == INDEX_EMPTY)
+        break;
+      if (s.entry == entry)
+        {
+          s.entry = INDEX_DELETED;
+          write_slot (index, slot, &s);
+          break;
+        }
+    }
+}
+
+/* Adds every entry of the directory in DIR_INODE to INDEX, which
+   must be empty.  Returns false if one does not fit. */
+static bool
+index_fill (struct inode *dir_inode, struct inode *index)
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  for (ofs = sizeof e;
+       inode_read_at (dir_inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && !index_insert (index, hash_string (e.name),
+                                   ofs / sizeof e))
+      return false;
+  return true;
+}
+
+/* Builds a new hash index with SLOT_CNT slots, which must be a
+   power of 2, for the directory in DIR_INODE, replacing any old
+   one.  Doubles the size until every entry fits.  Returns false,
+   leaving the old index in place, if the disk is full. */
+static bool
+index_build (struct inode *dir_inode, size_t slot_cnt)
+{
+  for (;; slot_cnt *= 2)
+    {
+      block_sector_t sector;
+      struct inode *index = NULL;
+      bool filled;
+
+      if (!free_map_allocate (1, inode_get_inumber (dir_inode), &sector))
+        return false;
+      if (inode_create (sector, slot_cnt * sizeof (struct index_slot)))
+        index = inode_open (sector);
+      if (index == NULL)
+        {
+          free_map_release (sector, 1);
+          return false;
+        }
+      inode_set_metadata (index);
+
+      filled = index_fill (dir_inode, index);
+      if (filled)
+        index_set (dir_inode, sector, chain_free_entries (dir_inode));
+      else
+        inode_remove (index);
+      inode_close (index);
+      if (filled)
+        return true;
+    }
+}
+
+/* Links every free entry of the directory in DIR_INODE into a
+   chain through their inode_sector members, and returns the
+   number of the first, or 0 if there are none. */
+static uint32_t
+chain_free_entries (struct inode *dir_inode)
+{
+  struct dir_entry e;
+  uint32_t head = 0;
+  off_t ofs;
+
+  for (ofs = sizeof e;
+       inode_read_at (dir_inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (!e.in_use)
+      {
+        e.inode_sector = head;
+        inode_write_at (dir_inode, &e, sizeof e, ofs);
+        head = ofs / sizeof e;
+      }
+  return head;
+}
+
+/* Makes the inode in SECTOR the hash index of the directory in
+   DIR_INODE, with its free chain starting at FREE_ENTRY, or
+   leaves it without an index if SECTOR is 0, and deletes its old
+   index. */
+static void
+index_set (struct inode *dir_inode, block_sector_t sector,
+           uint32_t free_entry)
+{
+  struct inode *old = index_open (dir_inode);
+  struct dir_header h;
+
+  memset (&h, 0, sizeof h);
+  h.index_sector = sector;
+  h.free_entry = free_entry;
+  write_header (dir_inode, &h);
+  if (old != NULL)
+    {
+      inode_remove (old);
+      inode_close (old);
+    }
+}
+
+/* Reads the header of the directory in DIR_INODE into *H.
+   Returns false if it cannot be read. */
+static bool
+read_header (struct inode *dir_inode, struct dir_header *h)
+{
+  return inode_read_at (dir_inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Writes *H as the header of the directory in DIR_INODE. */
+static void
+write_header (struct inode *dir_inode, const struct dir_header *h)
+{
+  inode_write_at (dir_inode, h, sizeof *h, 0);
+}
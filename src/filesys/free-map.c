@@ -1,52 +1,113 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The free map is kept on disk as a bitmap with one bit per
+   sector.  In memory, the free sectors are also kept as a list
+   of extents, maximal runs of free sectors, sorted by starting
+   sector, which lets an allocation find free space next to a
+   goal sector with a binary search instead of scanning the
+   bitmap from the start.
+
+   The extents are always a subset of the sectors that the
+   bitmap says are free.  If the extent array cannot grow to
+   record a released run, that run is only marked free in the
+   bitmap, and the extents are rebuilt from the bitmap the next
+   time an allocation would otherwise fail. */
+
+/* A run of free sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+  };
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct extent *extents;       /* Free extents, by start. */
+static size_t extent_cnt;            /* Number of extents. */
+static size_t extent_cap;            /* Allocated size of extents. */
+static bool extents_lost;            /* Free runs missing from extents? */
+static struct lock free_map_lock;    /* Guards all of the above. */
+
+static void rebuild_extents (void);
+static bool take_extent (size_t cnt, block_sector_t goal,
+                         block_sector_t *sectorp);
+static void add_extent (block_sector_t start, size_t cnt);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  rebuild_extents ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The sectors are placed at GOAL if
+   possible, or otherwise in the first run of free sectors after
+   GOAL that is big enough, wrapping around to the start of the
+   disk.  Callers pass the sector just after the last one of the
+   same file, or after its inode, so that files are laid out
+   contiguously.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (size_t cnt, block_sector_t goal,
+                   block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = take_extent (cnt, goal, &sector);
+  if (!success && extents_lost)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      rebuild_extents ();
+      success = take_extent (cnt, goal, &sector);
     }
-  if (sector != BITMAP_ERROR)
+  if (success)
+    {
+      ASSERT (bitmap_none (free_map, sector, cnt));
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false); 
+          add_extent (sector, cnt);
+          success = false;
+        }
+    }
+  lock_release (&free_map_lock);
+  if (success)
     *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  return success;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
+  add_extent (sector, cnt);
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,8 +117,12 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  lock_acquire (&free_map_lock);
+  rebuild_extents ();
+  lock_release (&free_map_lock);
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -72,14 +137,233 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The first write allocates the file's
+     sectors, which flips bits in the bitmap as it is being
+     written, so write it a second time to record them.  Until
+     free_map_file is set, free_map_allocate() does not write the
+     bitmap itself, which would recurse into the inode that is
+     being grown. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  inode_set_metadata (file_get_inode (file));
+  if (!bitmap_write (free_map, file) || !bitmap_write (free_map, file))
     PANIC ("can't write free map");
+  free_map_file = file;
+}
+
+/* Obtains statistics about free space, for reporting
+   fragmentation. */
+void
+free_map_get_stats (struct free_map_stats *stats)
+{
+  size_t i;
+
+  memset (stats, 0, sizeof *stats);
+  lock_acquire (&free_map_lock);
+  stats->sector_cnt = bitmap_size (free_map);
+  stats->free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map),
+                                  false);
+  stats->extent_cnt = extent_cnt;
+  for (i = 0; i < extent_cnt; i++)
+    {
+      size_t cnt = extents[i].cnt;
+      int bucket = 0;
+
+      if (cnt > stats->largest_extent)
+        stats->largest_extent = cnt;
+      while (cnt > 1 && bucket < FREE_MAP_BUCKET_CNT - 1)
+        {
+          cnt /= 2;
+          bucket++;
+        }
+      stats->extent_hist[bucket]++;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Returns the index of the first extent that starts after
+   SECTOR, or extent_cnt if there is none.  Must be called with
+   free_map_lock held. */
+static size_t
+find_extent (block_sector_t sector)
+{
+  size_t lo = 0, hi = extent_cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (extents[mid].start <= sector)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Makes room for another extent at index IDX, moving the ones
+   from there on up.  Returns false if the array cannot grow.
+   Must be called with free_map_lock held. */
+static bool
+insert_extent (size_t idx)
+{
+  if (extent_cnt >= extent_cap)
+    {
+      size_t new_cap = extent_cap > 0 ? extent_cap * 2 : 64;
+      struct extent *new_extents = realloc (extents,
+                                            new_cap * sizeof *extents);
+      if (new_extents == NULL)
+        return false;
+      extents = new_extents;
+      extent_cap = new_cap;
+    }
+  memmove (extents + idx + 1, extents + idx,
+           (extent_cnt - idx) * sizeof *extents);
+  extent_cnt++;
+  return true;
+}
+
+/* Removes the extent at index IDX.  Must be called with
+   free_map_lock held. */
+static void
+remove_extent (size_t idx)
+{
+  extent_cnt--;
+  memmove (extents + idx, extents + idx + 1,
+           (extent_cnt - idx) * sizeof *extents);
+}
+
+/* Removes CNT sectors starting at SECTOR, which must lie within
+   extent IDX, from the extents.  Returns false if doing so
+   splits the extent in two and the array cannot grow.  Must be
+   called with free_map_lock held. */
+static bool
+carve_extent (size_t idx, block_sector_t sector, size_t cnt)
+{
+  struct extent *e = &extents[idx];
+  block_sector_t end = e->start + e->cnt;
+
+  ASSERT (sector >= e->start && sector + cnt <= end);
+  if (sector == e->start)
+    {
+      e->start += cnt;
+      e->cnt -= cnt;
+      if (e->cnt == 0)
+        remove_extent (idx);
+    }
+  else if (sector + cnt == end)
+    e->cnt -= cnt;
+  else
+    {
+      if (!insert_extent (idx + 1))
+        return false;
+      e = &extents[idx];
+      e->cnt = sector - e->start;
+      extents[idx + 1].start = sector + cnt;
+      extents[idx + 1].cnt = end - (sector + cnt);
+    }
+  return true;
+}
+
+/* Takes CNT free sectors out of the extents, as described for
+   free_map_allocate(), and stores the first into *SECTORP.
+   Returns false if no extent is big enough.  Must be called
+   with free_map_lock held. */
+static bool
+take_extent (size_t cnt, block_sector_t goal, block_sector_t *sectorp)
+{
+  size_t first, i;
+
+  if (extent_cnt == 0)
+    return false;
+
+  /* Take the sectors at GOAL itself if the extent that holds it
+     has room enough after it.  Otherwise take the start of the
+     first big enough extent after GOAL. */
+  first = find_extent (goal);
+  if (first > 0)
+    {
+      struct extent *e = &extents[first - 1];
+      if (goal < e->start + e->cnt && e->start + e->cnt - goal >= cnt
+          && carve_extent (first - 1, goal, cnt))
+        {
+          *sectorp = goal;
+          return true;
+        }
+    }
+  for (i = 0; i < extent_cnt; i++)
+    {
+      size_t idx = (first + i) % extent_cnt;
+      if (extents[idx].cnt >= cnt)
+        {
+          *sectorp = extents[idx].start;
+          return carve_extent (idx, *sectorp, cnt);
+        }
+    }
+  return false;
+}
+
+/* Adds CNT sectors starting at START to the extents, merging
+   them with their neighbors.  If the array cannot grow, notes
+   that the extents are missing free sectors.  Must be called
+   with free_map_lock held. */
+static void
+add_extent (block_sector_t start, size_t cnt)
+{
+  size_t idx = find_extent (start);
+  bool merge_prev = idx > 0
+                    && extents[idx - 1].start + extents[idx - 1].cnt == start;
+  bool merge_next = idx < extent_cnt && start + cnt == extents[idx].start;
+
+  if (merge_prev && merge_next)
+    {
+      extents[idx - 1].cnt += cnt + extents[idx].cnt;
+      remove_extent (idx);
+    }
+  else if (merge_prev)
+    extents[idx - 1].cnt += cnt;
+  else if (merge_next)
+    {
+      extents[idx].start = start;
+      extents[idx].cnt += cnt;
+    }
+  else if (insert_extent (idx))
+    {
+      extents[idx].start = start;
+      extents[idx].cnt = cnt;
+    }
+  else
+    extents_lost = true;
+}
+
+/* Rebuilds the extents from the bitmap.  Must be called with
+   free_map_lock held, or before anyone else uses the free
+   map. */
+static void
+rebuild_extents (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = 0;
+
+  extent_cnt = 0;
+  extents_lost = false;
+  for (;;)
+    {
+      size_t end;
+
+      start = bitmap_scan (free_map, start, 1, false);
+      if (start == BITMAP_ERROR)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = size;
+      add_extent (start, end - start);
+      start = end;
+    }
 }
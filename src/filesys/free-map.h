@@ -5,13 +5,29 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+/* Number of buckets in the histogram of free extent sizes.
+   Bucket I counts extents of 2**I to 2**(I+1) - 1 sectors; the
+   last also counts all bigger ones. */
+#define FREE_MAP_BUCKET_CNT 12
+
+/* Free space statistics. */
+struct free_map_stats
+  {
+    size_t sector_cnt;                  /* Sectors on the device. */
+    size_t free_cnt;                    /* Free sectors. */
+    size_t extent_cnt;                  /* Runs of free sectors. */
+    size_t largest_extent;              /* Sectors in longest run. */
+    size_t extent_hist[FREE_MAP_BUCKET_CNT]; /* Runs by size. */
+  };
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
-bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate (size_t, block_sector_t goal, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_get_stats (struct free_map_stats *);
 
 #endif /* filesys/free-map.h */
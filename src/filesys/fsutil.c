@@ -7,6 +7,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -221,3 +223,43 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Reports how fragmented the file system is: how free space is
+   split into runs of free sectors, and how many runs of sectors
+   each file in the root directory occupies. */
+void
+fsutil_frag (char **argv UNUSED) 
+{
+  struct free_map_stats stats;
+  struct dir *dir;
+  char name[NAME_MAX + 1];
+  int i;
+
+  free_map_get_stats (&stats);
+  printf ("Free space: %zu of %zu sectors free in %zu extents, "
+          "largest %zu sectors\n", stats.free_cnt, stats.sector_cnt,
+          stats.extent_cnt, stats.largest_extent);
+  for (i = 0; i < FREE_MAP_BUCKET_CNT - 1; i++)
+    if (stats.extent_hist[i] > 0)
+      printf ("  %6zu extents of %d to %d sectors\n",
+              stats.extent_hist[i], 1 << i, (2 << i) - 1);
+  if (stats.extent_hist[i] > 0)
+    printf ("  %6zu extents of %d or more sectors\n",
+            stats.extent_hist[i], 1 << i);
+
+  printf ("Files in the root directory:\n");
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  while (dir_readdir (dir, name))
+    {
+      struct inode *inode;
+
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      printf ("  %-14s %8"PROTd" bytes in %zu extents\n", name,
+              inode_length (inode), inode_extent_cnt (inode));
+      inode_close (inode);
+    }
+  dir_close (dir);
+}
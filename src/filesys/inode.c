@@ -1,27 +1,48 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers held directly in the inode, in one
+   indirect block, and (through INDIRECT_CNT indirect blocks) in
+   the doubly indirect block. */
+#define DIRECT_CNT 124
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define DOUBLY_CNT (INDIRECT_CNT * INDIRECT_CNT)
+
+/* Most sectors a file can have, a little over 8 MB of data. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + DOUBLY_CNT)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   A sector pointer of 0 means that no sector has been allocated
+   there yet.  Sector 0 always holds the free map's inode, so it
+   can never be a file's data or index sector.  Reading a hole
+   yields zeros; writing one allocates it. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Data sectors. */
+    block_sector_t indirect;            /* Block of data sectors. */
+    block_sector_t doubly_indirect;     /* Block of indirect blocks. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
+/* Returns the number of sectors needed to hold SIZE bytes. */
 static inline size_t
 bytes_to_sectors (off_t size)
 {
@@ -31,44 +52,260 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inode table. */
+    struct list_elem lru_elem;          /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool metadata;                      /* Contents are metadata? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rw;                   /* Guards data and deny_write_cnt. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Returns entry IDX of the index block in SECTOR. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+index_read (block_sector_t sector, size_t idx) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  block_sector_t entry;
+
+  cache_read_at (sector, &entry, idx * sizeof entry, sizeof entry);
+  return entry;
+}
+
+/* Returns the block device sector that holds sector IDX of
+   INODE's data, or 0 if that sector has not been allocated. */
+static block_sector_t
+index_to_sector (const struct inode *inode, size_t idx) 
+{
+  const struct inode_disk *data = &inode->data;
+  block_sector_t indirect;
+
+  if (idx < DIRECT_CNT)
+    return data->direct[idx];
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT)
+    return data->indirect != 0 ? index_read (data->indirect, idx) : 0;
+  idx -= INDIRECT_CNT;
+
+  if (idx >= DOUBLY_CNT || data->doubly_indirect == 0)
+    return 0;
+  indirect = index_read (data->doubly_indirect, idx / INDIRECT_CNT);
+  return indirect != 0 ? index_read (indirect, idx % INDIRECT_CNT) : 0;
+}
+
+/* If *SECTORP is 0, allocates a sector, as close to GOAL as
+   possible, fills it with zeros, and stores its number in
+   *SECTORP.  The zeros only go to the buffer cache; the caller
+   is expected to overwrite them.  META says whether the sector
+   will hold metadata.
+   Returns false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp, block_sector_t goal, bool meta) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (*sectorp != 0)
+    return true;
+  if (!free_map_allocate (1, goal, sectorp))
+    return false;
+  if (meta)
+    cache_write_meta (*sectorp, zeros);
   else
-    return -1;
+    cache_write (*sectorp, zeros);
+  return true;
+}
+
+/* Returns entry IDX of the index block in SECTOR, first
+   allocating a zeroed sector for it, as close to GOAL as
+   possible, if it is 0.  META says whether the new sector will
+   hold metadata.  Returns 0 if the disk is full. */
+static block_sector_t
+index_allocate (block_sector_t sector, size_t idx, block_sector_t goal,
+                bool meta) 
+{
+  block_sector_t entry = index_read (sector, idx);
+
+  if (entry == 0 && allocate_zeroed (&entry, goal, meta))
+    cache_write_meta_at (sector, &entry, idx * sizeof entry, sizeof entry);
+  return entry;
+}
+
+/* Releases *SECTORP, allocated by allocate_zeroed() on the way
+   to a data sector that could not be allocated, and sets it back
+   to 0. */
+static void
+unallocate (block_sector_t *sectorp) 
+{
+  free_map_release (*sectorp, 1);
+  *sectorp = 0;
+}
+
+/* Returns the block device sector that holds sector IDX of
+   INODE's data, allocating it and any index blocks on the way
+   to it that are missing.  The caller must write INODE's
+   inode_disk back afterward, since its pointers may change.
+   Returns 0 if IDX is too big or the disk is full, in which case
+   any index blocks allocated along the way are released again. */
+static block_sector_t
+index_to_sector_allocate (struct inode *inode, size_t idx) 
+{
+  struct inode_disk *data = &inode->data;
+  block_sector_t indirect, sector, goal;
+  bool new_doubly, new_indirect;
+
+  /* Aim for the sector after the file's previous one, or after
+     the inode for its first, so that the file is laid out in
+     one run.  Index blocks take the goal too, just ahead of the
+     data they index. */
+  goal = idx > 0 ? index_to_sector (inode, idx - 1) : 0;
+  goal = (goal != 0 ? goal : inode->sector) + 1;
+
+  if (idx < DIRECT_CNT)
+    return (allocate_zeroed (&data->direct[idx], goal, inode->metadata)
+            ? data->direct[idx] : 0);
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT)
+    {
+      new_indirect = data->indirect == 0;
+      if (!allocate_zeroed (&data->indirect, goal, true))
+        return 0;
+      sector = index_allocate (data->indirect, idx, goal, inode->metadata);
+      if (sector == 0 && new_indirect)
+        unallocate (&data->indirect);
+      return sector;
+    }
+  idx -= INDIRECT_CNT;
+
+  if (idx >= DOUBLY_CNT)
+    return 0;
+  new_doubly = data->doubly_indirect == 0;
+  if (!allocate_zeroed (&data->doubly_indirect, goal, true))
+    return 0;
+  new_indirect = index_read (data->doubly_indirect,
+                             idx / INDIRECT_CNT) == 0;
+  indirect = index_allocate (data->doubly_indirect, idx / INDIRECT_CNT,
+                             goal, true);
+  sector = (indirect != 0
+            ? index_allocate (indirect, idx % INDIRECT_CNT, goal,
+                              inode->metadata)
+            : 0);
+
+  /* Don't leave behind index blocks that index nothing. */
+  if (sector == 0)
+    {
+      if (indirect != 0 && new_indirect)
+        {
+          block_sector_t zero = 0;
+
+          cache_write_meta_at (data->doubly_indirect, &zero,
+                               idx / INDIRECT_CNT * sizeof zero,
+                               sizeof zero);
+          unallocate (&indirect);
+        }
+      if (new_doubly)
+        unallocate (&data->doubly_indirect);
+    }
+  return sector;
+}
+
+/* Releases SECTOR and, if it is an index block DEPTH levels
+   above the data, every sector it points to.  Reads the index
+   entries one at a time through the buffer cache, so that it
+   needs no memory of its own and cannot fail partway. */
+static void
+release_index (block_sector_t sector, int depth) 
+{
+  if (sector == 0)
+    return;
+
+  if (depth > 0) 
+    {
+      size_t i;
+
+      for (i = 0; i < INDIRECT_CNT; i++)
+        release_index (index_read (sector, i), depth - 1);
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases every data and index sector allocated to INODE. */
+static void
+release_sectors (struct inode *inode) 
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_index (inode->data.direct[i], 0);
+  release_index (inode->data.indirect, 1);
+  release_index (inode->data.doubly_indirect, 2);
+}
+
+/* Table of in-memory inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'.
+
+   An inode stays in the table after its last opener closes it,
+   on closed_inodes, so that reopening it soon after needs no
+   disk I/O.  Once more than inode_cache_max inodes are closed,
+   the least recently closed one is freed.  Removed inodes are
+   freed as soon as they are closed. */
+static struct hash inodes;
+static struct list closed_inodes;       /* Most recently closed first. */
+static size_t closed_cnt;               /* Number in closed_inodes. */
+
+/* -ic: Maximum number of closed inodes to keep. */
+size_t inode_cache_max = 64;
+
+/* Opens that found the inode in the table, and that read it. */
+static long long hit_cnt, miss_cnt;
+
+/* Protects everything above and the open_cnt and removed members
+   of every inode in the table.  Each inode's own contents are
+   guarded by its readers-writer lock instead, so that I/O on
+   different inodes can proceed at the same time. */
+static struct lock inodes_lock;
+
+/* In-memory inodes. */
+static struct slab_cache inode_cache;
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, hash_elem);
+  return hash_int (inode->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, hash_elem);
+  const struct inode *b = hash_entry (b_, struct inode, hash_elem);
+  return a->sector < b->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&inodes, inode_hash, inode_less, NULL);
+  list_init (&closed_inodes);
+  lock_init (&inodes_lock);
+  slab_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  No data sectors are allocated yet: they are
+   allocated as they are first written, and read as zeros until
+   then.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is larger
+   than the biggest file an inode can index. */
 bool
 inode_create (block_sector_t sector, off_t length)
 {
@@ -81,26 +318,17 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (bytes_to_sectors (length) > MAX_SECTORS)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      cache_write_meta (sector, disk_inode);
       free (disk_inode);
+      success = true; 
     }
   return success;
 }
@@ -111,33 +339,54 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&inodes_lock);
+
+  /* Check whether this inode is already in memory, and if it is
+     closed, take it off closed_inodes. */
+  key.sector = sector;
+  e = hash_find (&inodes, &key.hash_elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, hash_elem);
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->lru_elem);
+          closed_cnt--;
         }
+      hit_cnt++;
+      lock_release (&inodes_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = slab_alloc (&inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  Hold the new inode for writing while its disk
+     copy is read, so that anyone who finds it in the table in
+     the meantime waits for the read to finish instead of holding
+     up every other open. */
   inode->sector = sector;
+  hash_insert (&inodes, &inode->hash_elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->metadata = false;
+  rwlock_init (&inode->rw);
+  rwlock_acquire_write (&inode->rw);
+  miss_cnt++;
+  lock_release (&inodes_lock);
+
+  cache_read (inode->sector, &inode->data);
+  rwlock_release_write (&inode->rw);
   return inode;
 }
 
@@ -146,7 +395,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inodes_lock);
+      inode->open_cnt++;
+      lock_release (&inodes_lock);
+    }
   return inode;
 }
 
@@ -158,31 +411,57 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it on
+   closed_inodes in case it is reopened soon, freeing the least
+   recently closed inode if there are too many.
+   If INODE was also a removed inode, frees it and its blocks
+   instead. */
 void
 inode_close (struct inode *inode) 
 {
+  struct inode *victim = NULL;
+  bool removed = false;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  lock_acquire (&inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      if (inode->removed)
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          hash_delete (&inodes, &inode->hash_elem);
+          removed = true;
         }
+      else
+        {
+          list_push_front (&closed_inodes, &inode->lru_elem);
+          if (++closed_cnt > inode_cache_max)
+            {
+              victim = list_entry (list_pop_back (&closed_inodes),
+                                   struct inode, lru_elem);
+              hash_delete (&inodes, &victim->hash_elem);
+              closed_cnt--;
+            }
+        }
+    }
+  lock_release (&inodes_lock);
 
-      free (inode); 
+  /* Nobody else can reach INODE, if it was removed, or VICTIM any
+     more, so no lock is needed.  The disk already has VICTIM's
+     latest contents, since they are written whenever they
+     change. */
+  if (removed) 
+    {
+      journal_begin ();
+      release_sectors (inode);
+      free_map_release (inode->sector, 1);
+      journal_end ();
+      slab_free (&inode_cache, inode);
     }
+  if (victim != NULL)
+    slab_free (&inode_cache, victim);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +470,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inodes_lock);
   inode->removed = true;
+  lock_release (&inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,16 +483,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rw);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx = index_to_sector (inode, idx);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,23 +502,19 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx != 0)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
+
+      /* Fetch the following sector in the background, on the
+         guess that the file is being read sequentially. */
+      if (inode_left > sector_left) 
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          block_sector_t next = index_to_sector (inode, idx + 1);
+          if (next != 0)
+            cache_readahead (next);
         }
       
       /* Advance. */
@@ -244,75 +522,81 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rw);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Writing past end of file extends the inode, allocating
+   sectors for the new data as needed; any gap between the old
+   end of file and OFFSET reads as zeros.  Each sector is
+   allocated in a journal operation of its own, together with
+   the index blocks and inode pointers that lead to it, so that a
+   long write does not hold one operation open throughout.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up, the maximum file size is
+   reached, or an error occurs. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rw);
+      return 0;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx = index_to_sector (inode, idx);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Allocate the sector on first write, and write back the
+         inode's new pointers along with it. */
+      if (sector_idx == 0) 
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          journal_begin ();
+          sector_idx = index_to_sector_allocate (inode, idx);
+          if (sector_idx != 0)
+            cache_write_meta (inode->sector, &inode->data);
+          journal_end ();
+          if (sector_idx == 0)
+            break;
         }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      if (inode->metadata)
+        cache_write_meta_at (sector_idx, buffer + bytes_written,
+                             sector_ofs, chunk_size);
+      else
+        cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                        chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file and write back its new length. */
+  if (bytes_written > 0 && offset > inode->data.length) 
+    {
+      inode->data.length = offset;
+      cache_write_meta (inode->sector, &inode->data);
+    }
+  rwlock_release_write (&inode->rw);
 
   return bytes_written;
 }
@@ -322,8 +606,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +618,60 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
+}
+
+/* Marks INODE's contents as file system metadata, so that
+   writes to them go through the journal. */
+void
+inode_set_metadata (struct inode *inode) 
+{
+  inode->metadata = true;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
-  return inode->data.length;
+  struct inode *i = (struct inode *) inode;
+  off_t length;
+
+  rwlock_acquire_read (&i->rw);
+  length = i->data.length;
+  rwlock_release_read (&i->rw);
+  return length;
+}
+
+/* Returns the number of runs of consecutive sectors that hold
+   INODE's data, for reporting fragmentation.  A file laid out
+   contiguously has 1, or 0 if it has no data sectors. */
+size_t
+inode_extent_cnt (struct inode *inode)
+{
+  block_sector_t prev = 0;
+  size_t cnt = 0;
+  size_t idx;
+
+  rwlock_acquire_read (&inode->rw);
+  for (idx = 0; idx < bytes_to_sectors (inode->data.length); idx++)
+    {
+      block_sector_t sector = index_to_sector (inode, idx);
+      if (sector != 0 && (prev == 0 || sector != prev + 1))
+        cnt++;
+      prev = sector;
+    }
+  rwlock_release_read (&inode->rw);
+  return cnt;
+}
+
+/* Prints statistics for the in-memory inode table. */
+void
+inode_print_stats (void) 
+{
+  printf ("Inodes: %lld opens found in memory, %lld read from disk, "
+          "%zu closed inodes kept\n", hit_cnt, miss_cnt, closed_cnt);
 }
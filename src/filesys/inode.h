@@ -2,11 +2,16 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
 
+/* Maximum number of closed inodes kept in memory.
+   Controlled by kernel command-line option "-ic". */
+extern size_t inode_cache_max;
+
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
 struct inode *inode_open (block_sector_t);
@@ -18,6 +23,9 @@ off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_set_metadata (struct inode *);
 off_t inode_length (const struct inode *);
+size_t inode_extent_cnt (struct inode *);
+void inode_print_stats (void);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,289 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead metadata journal.
+
+   Sectors that hold file system metadata (inodes, index blocks,
+   directories and the free map) are never written in place
+   straight from the buffer cache.  Instead, the cache collects
+   them into a transaction, and cache_flush() commits all of them
+   at once: it writes their contents to the journal, then a
+   header that lists their home sectors, and only then writes
+   them home.  Once they are all home, the header is cleared.
+
+   If the machine stops before the header is written, none of the
+   transaction reached its home sectors.  If it stops after, the
+   whole transaction is copied home again from the journal by
+   journal_init(), so that the metadata on disk always reflects
+   a complete transaction.  File data is written before the
+   journal, so committed metadata never points to sectors that
+   do not yet hold their data.
+
+   Changes that span several metadata sectors, such as creating
+   a file, which allocates an inode sector in the free map and
+   adds it to a directory, are bracketed by journal_begin() and
+   journal_end().  cache_flush() waits until no such operation
+   is open before it gathers a transaction, and holds off new
+   ones while it does, so that a transaction contains either all
+   of an operation's changes or none of them.  Operations nest:
+   only the outermost journal_begin() and journal_end() in a
+   thread count.
+
+   The cache commits every COMMIT_INTERVAL ticks, whenever an
+   operation begins while dirty metadata fills half of it, and at
+   shutdown.  If open operations dirty more metadata than the
+   cache holds, it has to commit some of their changes without
+   waiting for them to finish; only then can an operation be
+   split across transactions. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Timer ticks between commits. */
+#define COMMIT_INTERVAL TIMER_FREQ
+
+/* Journal header, in sector JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction number. */
+    uint32_t cnt;                       /* Sectors, or 0 if none. */
+    unsigned checksum;                  /* Of sectors and contents. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Home sectors. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16
+                   - JOURNAL_MAX * sizeof (block_sector_t)];
+  };
+
+static uint32_t next_seq;               /* Number of next transaction. */
+static struct journal_header header;    /* Being written. */
+static struct block_request requests[JOURNAL_MAX];
+
+/* Operations in progress. */
+static struct lock ops_lock;            /* Protects the members below. */
+static struct condition ops_changed;    /* Signaled when they change. */
+static int open_cnt;                    /* Open operations. */
+static bool frozen;                     /* Holding off new operations? */
+
+static thread_func commit_thread;
+static void replay (void);
+static unsigned checksum (const block_sector_t[], size_t idx,
+                          const void *buffer, unsigned sum);
+static void write_header (uint32_t cnt);
+
+/* Initializes the journal.  If FORMAT is true, starts an empty
+   one; otherwise replays whatever transaction the journal
+   holds.  Then starts the thread that commits periodically. */
+void
+journal_init (bool format)
+{
+  lock_init (&ops_lock);
+  cond_init (&ops_changed);
+  open_cnt = 0;
+  frozen = false;
+
+  if (format)
+    {
+      next_seq = 0;
+      write_header (0);
+    }
+  else
+    replay ();
+  thread_create ("journal", PRI_DEFAULT, commit_thread, NULL);
+}
+
+/* Writes the CNT sectors in BUFFERS, whose home sectors are
+   SECTORS, to the journal, and does not return until they are
+   committed.  The caller must then write them home and call
+   journal_checkpoint() before committing again. */
+void
+journal_commit (size_t cnt, const block_sector_t sectors[],
+                void *const buffers[])
+{
+  unsigned sum = 0;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= JOURNAL_MAX);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct block_request *r = &requests[i];
+
+      r->sector = JOURNAL_SECTOR + 1 + i;
+      r->cnt = 1;
+      r->buffer = buffers[i];
+      r->write = true;
+      r->complete = NULL;
+      block_submit (fs_device, r);
+      header.sectors[i] = sectors[i];
+      sum = checksum (sectors, i, buffers[i], sum);
+    }
+  for (i = 0; i < cnt; i++)
+    block_wait (&requests[i]);
+
+  header.checksum = sum;
+  write_header (cnt);
+}
+
+/* Marks the journal empty, once every sector of the last
+   transaction has been written home. */
+void
+journal_checkpoint (void)
+{
+  next_seq++;
+  write_header (0);
+}
+
+/* Begins an operation that changes metadata, so that no commit
+   includes some of its changes without the rest.  If dirty
+   metadata already fills half the buffer cache, commits it first,
+   so that the operation finds room for its own.  Must be paired
+   with journal_end(). */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth == 0)
+    {
+      if (cache_should_commit ())
+        cache_flush ();
+
+      lock_acquire (&ops_lock);
+      while (frozen)
+        cond_wait (&ops_changed, &ops_lock);
+      open_cnt++;
+      lock_release (&ops_lock);
+    }
+  t->journal_depth++;
+}
+
+/* Ends an operation begun by journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&ops_lock);
+  if (--open_cnt == 0)
+    cond_broadcast (&ops_changed, &ops_lock);
+  lock_release (&ops_lock);
+}
+
+/* Waits until no operation is open and keeps new ones from
+   beginning until journal_thaw() is called.  The caller must not
+   have an operation open itself. */
+void
+journal_freeze (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&ops_lock);
+  while (frozen)
+    cond_wait (&ops_changed, &ops_lock);
+  frozen = true;
+  while (open_cnt > 0)
+    cond_wait (&ops_changed, &ops_lock);
+  lock_release (&ops_lock);
+}
+
+/* Lets the operations held off by journal_freeze() begin. */
+void
+journal_thaw (void)
+{
+  lock_acquire (&ops_lock);
+  ASSERT (frozen);
+  frozen = false;
+  cond_broadcast (&ops_changed, &ops_lock);
+  lock_release (&ops_lock);
+}
+
+/* Commits every COMMIT_INTERVAL ticks. */
+static void
+commit_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Copies the transaction in the journal, if any, to its home
+   sectors, unless the machine stopped before it was committed.
+   Bypasses the buffer cache, which is still empty. */
+static void
+replay (void)
+{
+  uint8_t *buffer = malloc (BLOCK_SECTOR_SIZE);
+  unsigned sum = 0;
+  size_t i;
+
+  if (buffer == NULL)
+    PANIC ("can't allocate journal buffer");
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC || header.cnt > JOURNAL_MAX)
+    PANIC ("file system journal is corrupt");
+  next_seq = header.seq + 1;
+
+  if (header.cnt > 0)
+    {
+      for (i = 0; i < header.cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_SECTOR + 1 + i, buffer);
+          sum = checksum (header.sectors, i, buffer, sum);
+        }
+      if (sum != header.checksum)
+        PANIC ("file system journal checksum mismatch");
+
+      for (i = 0; i < header.cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_SECTOR + 1 + i, buffer);
+          block_write (fs_device, header.sectors[i], buffer);
+        }
+      printf ("journal: replayed %"PRIu32" sectors of transaction "
+              "%"PRIu32"\n", header.cnt, header.seq);
+      write_header (0);
+    }
+  free (buffer);
+}
+
+/* Returns SUM updated with entry IDX of a transaction, home
+   sector SECTORS[IDX] holding the sector's worth of data in
+   BUFFER. */
+static unsigned
+checksum (const block_sector_t sectors[], size_t idx, const void *buffer,
+          unsigned sum)
+{
+  sum = sum * 31 + hash_int (sectors[idx]);
+  return sum * 31 + hash_bytes (buffer, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the header for transaction next_seq with CNT sectors,
+   whose home sectors and checksum must already be in header. */
+static void
+write_header (uint32_t cnt)
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  header.magic = JOURNAL_MAGIC;
+  header.seq = next_seq;
+  header.cnt = cnt;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most sectors in one transaction.  Must be at least the number
+   of sectors in the buffer cache. */
+#define JOURNAL_MAX 64
+
+/* Sectors of the file system device that hold the journal: a
+   header, then room for the contents of JOURNAL_MAX sectors. */
+#define JOURNAL_SECTOR 2
+#define JOURNAL_SECTORS (JOURNAL_MAX + 1)
+
+void journal_init (bool format);
+void journal_commit (size_t cnt, const block_sector_t sectors[],
+                     void *const buffers[]);
+void journal_checkpoint (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_freeze (void);
+void journal_thaw (void);
+
+#endif /* filesys/journal.h */
@@ -60,6 +60,34 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns an elem_type with the CNT bits starting at bit OFS
+   turned on.  OFS + CNT must not exceed ELEM_BITS. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt) 
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  return mask << ofs;
+}
+
+/* Returns the number of bits set in X.  Done by hand, because
+   __builtin_popcount() becomes a libgcc call on i686. */
+static inline int
+popcount (elem_type x) 
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
+
+/* Returns the index of the lowest bit set in X, which must not
+   be 0.  Compiles to a single BSF instruction. */
+static inline int
+lowest_bit (elem_type x) 
+{
+  return __builtin_ctzl (x);
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -69,6 +97,85 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+#ifdef __SSE2__
+/* A 128-bit SSE2 vector of bytes. */
+typedef char v16qi __attribute__ ((vector_size (16)));
+
+/* Returns the index of the first element at or after IDX and
+   before END in BITS that differs from FILL, or END if there is
+   none, checking 4 elements at a time with SSE2.
+
+   The kernel is built for plain i686 and never enables SSE, so
+   this is only compiled into host builds, such as the benchmark
+   in tests/internal. */
+static size_t
+skip_fill (const elem_type *bits, size_t idx, size_t end, elem_type fill) 
+{
+  const v16qi fills = (v16qi) { (char) fill, (char) fill, (char) fill,
+                                (char) fill, (char) fill, (char) fill,
+                                (char) fill, (char) fill, (char) fill,
+                                (char) fill, (char) fill, (char) fill,
+                                (char) fill, (char) fill, (char) fill,
+                                (char) fill };
+  const size_t per_vec = 16 / sizeof (elem_type);
+
+  for (; idx < end && (uintptr_t) &bits[idx] % 16 != 0; idx++)
+    if (bits[idx] != fill)
+      return idx;
+  for (; idx + per_vec <= end; idx += per_vec)
+    {
+      v16qi v = *(const v16qi *) &bits[idx];
+      if (__builtin_ia32_pmovmskb128 (__builtin_ia32_pcmpeqb128 (v, fills))
+          != 0xffff)
+        break;
+    }
+  while (idx < end && bits[idx] == fill)
+    idx++;
+  return idx;
+}
+#else
+/* Returns the index of the first element at or after IDX and
+   before END in BITS that differs from FILL, or END if there is
+   none. */
+static inline size_t
+skip_fill (const elem_type *bits, size_t idx, size_t end, elem_type fill) 
+{
+  while (idx < end && bits[idx] == fill)
+    idx++;
+  return idx;
+}
+#endif
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none.
+   Elements with no such bit are skipped whole. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, end_idx;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+
+  /* Make VALUE bits 1, and ignore the bits before START. */
+  idx = elem_idx (start);
+  end_idx = elem_idx (end - 1);
+  e = (b->bits[idx] ^ flip) & ~range_mask (0, start % ELEM_BITS);
+  if (e == 0 && idx < end_idx)
+    {
+      idx = skip_fill (b->bits, idx + 1, end_idx, flip);
+      e = b->bits[idx] ^ flip;
+    }
+  if (e != 0)
+    {
+      size_t bit_idx = idx * ELEM_BITS + lowest_bit (e);
+      return bit_idx < end ? bit_idx : end;
+    }
+  return end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -213,18 +320,34 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Whole elements are stored at once; the bits of partly covered
+   elements at either end are set atomically, as bitmap_mark()
+   and bitmap_reset() do. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+
+      if (n == ELEM_BITS)
+        b->bits[idx] = value ? (elem_type) -1 : 0;
+      else if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (range_mask (ofs, n))
+             : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~range_mask (ofs, n))
+             : "cc");
+      start += n;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +355,21 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t set_cnt, i, n;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  /* Count the bits that are set, a word at a time. */
+  set_cnt = 0;
+  for (i = start; i < start + cnt; i += n)
+    {
+      size_t ofs = i % ELEM_BITS;
+      n = ELEM_BITS - ofs < start + cnt - i ? ELEM_BITS - ofs : start + cnt - i;
+      set_cnt += popcount (b->bits[elem_idx (i)] & range_mask (ofs, n));
+    }
+  return value ? set_cnt : cnt - set_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,16 +377,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +420,28 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Find the next run of bits set to VALUE and see whether it
+         is long enough.  If not, the next candidate can only
+         start after the bit that ended the run. */
+      while (i <= last)
+        {
+          size_t run_start = find_bit (b, i, last + 1, value);
+          size_t run_end;
+
+          if (run_start > last)
+            break;
+          run_end = find_bit (b, run_start, run_start + cnt, !value);
+          if (run_end == run_start + cnt)
+            return run_start;
+          i = run_end + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -28,7 +28,27 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Clone this process. */
+    SYS_UPTIME,                 /* Timer ticks since boot. */
+
+    SYS_CNT                     /* Number of system calls. */
   };
 
+/* Number of arguments each system call takes, as an initializer
+   for an array indexed by system call number. */
+#define SYS_ARG_CNTS                                            \
+  {                                                             \
+    [SYS_HALT] = 0, [SYS_EXIT] = 1, [SYS_EXEC] = 1,             \
+    [SYS_WAIT] = 1, [SYS_CREATE] = 2, [SYS_REMOVE] = 1,         \
+    [SYS_OPEN] = 1, [SYS_FILESIZE] = 1, [SYS_READ] = 3,         \
+    [SYS_WRITE] = 3, [SYS_SEEK] = 2, [SYS_TELL] = 1,            \
+    [SYS_CLOSE] = 1, [SYS_MMAP] = 2, [SYS_MUNMAP] = 1,          \
+    [SYS_CHDIR] = 1, [SYS_MKDIR] = 1, [SYS_READDIR] = 2,        \
+    [SYS_ISDIR] = 1, [SYS_INUMBER] = 1, [SYS_FORK] = 0,         \
+    [SYS_UPTIME] = 0,                                           \
+  }
+
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,55 @@
+/* Child process for syn-scale test.
+   Reads its own test file a byte at a time, overwriting each
+   byte with its complement after checking it, so that the
+   processes spend most of their time reading and writing in the
+   kernel file system code at once, but on different inodes.  A
+   nonzero second argument says that the file has already been
+   complemented once. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-scale.h"
+
+const char *test_name = "child-syn-scale";
+
+static char buf[BUF_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[8];
+  int child_idx;
+  int fd;
+  bool flipped;
+  size_t i;
+
+  quiet = true;
+  
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  flipped = atoi (argv[2]) != 0;
+  snprintf (file_name, sizeof file_name, FILE_NAME_FMT, child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+  if (flipped)
+    for (i = 0; i < sizeof buf; i++)
+      buf[i] = ~buf[i];
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < sizeof buf; i++) 
+    {
+      char c;
+      CHECK (read (fd, &c, 1) > 0, "read \"%s\"", file_name);
+      compare_bytes (&c, buf + i, 1, i, file_name);
+      c = ~c;
+      seek (fd, i);
+      CHECK (write (fd, &c, 1) > 0, "write \"%s\"", file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,97 @@
+/* Spawns 10 child processes, each of which reads a different
+   file a byte at a time, makes sure that the contents are what
+   they should be, and complements each byte in place.  Runs the
+   children once one at a time and then again all at once, and
+   reports the timer ticks each run takes.  Since the children
+   never touch the same file, none of them should have to wait
+   for another in the file system, so the run with all of them
+   at once should take no longer than the other.  The tick counts
+   depend on the machine, so they are only printed.
+
+   Finally, checks that every file ended up with exactly its own
+   child's writes, complemented twice, none of them lost or
+   landing in another file. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-scale.h"
+
+static char buf[BUF_SIZE];
+
+static pid_t spawn_child (int child_idx, int flipped);
+static void wait_child (pid_t pid, int child_idx);
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  char file_name[8];
+  int serial_ticks, parallel_ticks;
+  int start;
+  int fd;
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, FILE_NAME_FMT, i);
+      CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      random_init (i);
+      random_bytes (buf, sizeof buf);
+      CHECK (write (fd, buf, sizeof buf) > 0, "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+    }
+
+  msg ("run children one at a time");
+  start = uptime ();
+  for (i = 0; i < CHILD_CNT; i++)
+    wait_child (spawn_child (i, 0), i);
+  serial_ticks = uptime () - start;
+
+  msg ("run children all at once");
+  start = uptime ();
+  for (i = 0; i < CHILD_CNT; i++)
+    children[i] = spawn_child (i, 1);
+  for (i = 0; i < CHILD_CNT; i++)
+    wait_child (children[i], i);
+  parallel_ticks = uptime () - start;
+
+  msg ("one at a time: %d ticks", serial_ticks);
+  msg ("all at once: %d ticks", parallel_ticks);
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, FILE_NAME_FMT, i);
+      random_init (i);
+      random_bytes (buf, sizeof buf);
+      check_file (file_name, buf, sizeof buf);
+    }
+}
+
+/* Starts the child that works on file CHILD_IDX, which expects
+   the file's contents to be complemented if FLIPPED is
+   nonzero. */
+static pid_t
+spawn_child (int child_idx, int flipped)
+{
+  char cmd_line[128];
+  pid_t pid;
+
+  snprintf (cmd_line, sizeof cmd_line, "child-syn-scale %d %d",
+            child_idx, flipped);
+  CHECK ((pid = exec (cmd_line)) != PID_ERROR, "exec \"%s\"", cmd_line);
+  return pid;
+}
+
+/* Waits for child PID, which works on file CHILD_IDX. */
+static void
+wait_child (pid_t pid, int child_idx)
+{
+  int status = wait (pid);
+  CHECK (status == child_idx, "wait for child %d returned %d",
+         child_idx, status);
+}
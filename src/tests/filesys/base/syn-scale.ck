@@ -0,0 +1,131 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The tick counts vary from run to run, so compare them as "#".
+s/^(\(syn-scale\) [a-z ]+: )\d+( ticks)$/$1#$2/ foreach @output;
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(syn-scale) begin
+(syn-scale) create "data0"
+(syn-scale) open "data0"
+(syn-scale) write "data0"
+(syn-scale) close "data0"
+(syn-scale) create "data1"
+(syn-scale) open "data1"
+(syn-scale) write "data1"
+(syn-scale) close "data1"
+(syn-scale) create "data2"
+(syn-scale) open "data2"
+(syn-scale) write "data2"
+(syn-scale) close "data2"
+(syn-scale) create "data3"
+(syn-scale) open "data3"
+(syn-scale) write "data3"
+(syn-scale) close "data3"
+(syn-scale) create "data4"
+(syn-scale) open "data4"
+(syn-scale) write "data4"
+(syn-scale) close "data4"
+(syn-scale) create "data5"
+(syn-scale) open "data5"
+(syn-scale) write "data5"
+(syn-scale) close "data5"
+(syn-scale) create "data6"
+(syn-scale) open "data6"
+(syn-scale) write "data6"
+(syn-scale) close "data6"
+(syn-scale) create "data7"
+(syn-scale) open "data7"
+(syn-scale) write "data7"
+(syn-scale) close "data7"
+(syn-scale) create "data8"
+(syn-scale) open "data8"
+(syn-scale) write "data8"
+(syn-scale) close "data8"
+(syn-scale) create "data9"
+(syn-scale) open "data9"
+(syn-scale) write "data9"
+(syn-scale) close "data9"
+(syn-scale) run children one at a time
+(syn-scale) exec "child-syn-scale 0 0"
+(syn-scale) wait for child 0 returned 0
+(syn-scale) exec "child-syn-scale 1 0"
+(syn-scale) wait for child 1 returned 1
+(syn-scale) exec "child-syn-scale 2 0"
+(syn-scale) wait for child 2 returned 2
+(syn-scale) exec "child-syn-scale 3 0"
+(syn-scale) wait for child 3 returned 3
+(syn-scale) exec "child-syn-scale 4 0"
+(syn-scale) wait for child 4 returned 4
+(syn-scale) exec "child-syn-scale 5 0"
+(syn-scale) wait for child 5 returned 5
+(syn-scale) exec "child-syn-scale 6 0"
+(syn-scale) wait for child 6 returned 6
+(syn-scale) exec "child-syn-scale 7 0"
+(syn-scale) wait for child 7 returned 7
+(syn-scale) exec "child-syn-scale 8 0"
+(syn-scale) wait for child 8 returned 8
+(syn-scale) exec "child-syn-scale 9 0"
+(syn-scale) wait for child 9 returned 9
+(syn-scale) run children all at once
+(syn-scale) exec "child-syn-scale 0 1"
+(syn-scale) exec "child-syn-scale 1 1"
+(syn-scale) exec "child-syn-scale 2 1"
+(syn-scale) exec "child-syn-scale 3 1"
+(syn-scale) exec "child-syn-scale 4 1"
+(syn-scale) exec "child-syn-scale 5 1"
+(syn-scale) exec "child-syn-scale 6 1"
+(syn-scale) exec "child-syn-scale 7 1"
+(syn-scale) exec "child-syn-scale 8 1"
+(syn-scale) exec "child-syn-scale 9 1"
+(syn-scale) wait for child 0 returned 0
+(syn-scale) wait for child 1 returned 1
+(syn-scale) wait for child 2 returned 2
+(syn-scale) wait for child 3 returned 3
+(syn-scale) wait for child 4 returned 4
+(syn-scale) wait for child 5 returned 5
+(syn-scale) wait for child 6 returned 6
+(syn-scale) wait for child 7 returned 7
+(syn-scale) wait for child 8 returned 8
+(syn-scale) wait for child 9 returned 9
+(syn-scale) one at a time: # ticks
+(syn-scale) all at once: # ticks
+(syn-scale) open "data0" for verification
+(syn-scale) verified contents of "data0"
+(syn-scale) close "data0"
+(syn-scale) open "data1" for verification
+(syn-scale) verified contents of "data1"
+(syn-scale) close "data1"
+(syn-scale) open "data2" for verification
+(syn-scale) verified contents of "data2"
+(syn-scale) close "data2"
+(syn-scale) open "data3" for verification
+(syn-scale) verified contents of "data3"
+(syn-scale) close "data3"
+(syn-scale) open "data4" for verification
+(syn-scale) verified contents of "data4"
+(syn-scale) close "data4"
+(syn-scale) open "data5" for verification
+(syn-scale) verified contents of "data5"
+(syn-scale) close "data5"
+(syn-scale) open "data6" for verification
+(syn-scale) verified contents of "data6"
+(syn-scale) close "data6"
+(syn-scale) open "data7" for verification
+(syn-scale) verified contents of "data7"
+(syn-scale) close "data7"
+(syn-scale) open "data8" for verification
+(syn-scale) verified contents of "data8"
+(syn-scale) close "data8"
+(syn-scale) open "data9" for verification
+(syn-scale) verified contents of "data9"
+(syn-scale) close "data9"
+(syn-scale) end
+EOF
+pass;
@@ -0,0 +1,11 @@
+#ifndef TESTS_FILESYS_BASE_SYN_SCALE_H
+#define TESTS_FILESYS_BASE_SYN_SCALE_H
+
+#define BUF_SIZE 1024
+#define CHILD_CNT 10
+
+/* Each child works on its own file, "data0" through "data9",
+   filled with random bytes seeded by the child's index. */
+#define FILE_NAME_FMT "data%d"
+
+#endif /* tests/filesys/base/syn-scale.h */
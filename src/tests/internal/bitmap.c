@@ -0,0 +1,238 @@
+/* Benchmark for lib/kernel/bitmap.c.
+
+   Unlike the other programs here, this one runs on the host
+   rather than inside Pintos.  It includes bitmap.c directly and
+   times bitmap_scan(), bitmap_count() and bitmap_set_multiple()
+   on a bitmap of 1M bits, comparing each against a bit-by-bit
+   version built on bitmap_test() and checking that they agree.
+   Times are in CPU cycles, as read by RDTSC.
+
+   To build and run it from the "src" directory:
+
+        gcc -m32 -O2 -nostdinc -Ilib -Ilib/kernel -I. \
+            tests/internal/bitmap.c lib/random.c -o bitmap-bench && \
+            ./bitmap-bench
+
+   Add -msse2 to use the SSE2 path for skipping over long
+   stretches of all-set or all-clear elements.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include "lib/kernel/bitmap.c"
+
+#include <random.h>
+#include <stdarg.h>
+#include <string.h>
+
+/* From the host's C library, which Pintos's headers lack. */
+void exit (int) NO_RETURN;
+
+/* Number of bits in the bitmap. */
+#define BIT_CNT (1024 * 1024)
+
+/* Number of times each operation is repeated. */
+#define REPEAT_CNT 20
+
+/* The functions that bitmap.c needs from the rest of Pintos. */
+
+void
+debug_panic (const char *file, int line, const char *function,
+             const char *message, ...)
+{
+  va_list args;
+
+  printf ("PANIC at %s:%d in %s(): ", file, line, function);
+  va_start (args, message);
+  vprintf (message, args);
+  va_end (args);
+  printf ("\n");
+  exit (1);
+}
+
+void
+hex_dump (uintptr_t ofs UNUSED, const void *buf UNUSED, size_t size UNUSED,
+          bool ascii UNUSED)
+{
+}
+
+/* Returns the CPU's time stamp counter. */
+static uint64_t
+cycles (void)
+{
+  return __builtin_ia32_rdtsc ();
+}
+
+/* Bit-by-bit versions, as bitmap.c did them before. */
+
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+static bool
+slow_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= b->bit_cnt)
+    {
+      size_t last = b->bit_cnt - cnt;
+      size_t i;
+      for (i = start; i <= last; i++)
+        if (!slow_contains (b, i, cnt, !value))
+          return i;
+    }
+  return BITMAP_ERROR;
+}
+
+static void
+slow_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    bitmap_set (b, start + i, value);
+}
+
+/* Fills B so that about one bit in every SPARSENESS is clear,
+   like the used map of a nearly full pool or disk.  If
+   SPARSENESS is 0, leaves every bit set. */
+static void
+fill (struct bitmap *b, unsigned sparseness)
+{
+  size_t i;
+
+  bitmap_set_all (b, true);
+  if (sparseness > 0)
+    for (i = 0; i < b->bit_cnt; i++)
+      if (random_ulong () % sparseness == 0)
+        bitmap_reset (b, i);
+}
+
+/* Times scanning B from the start for CNT clear bits, and
+   counting its clear bits, both ways.  Describes B as NAME. */
+static void
+bench_scan (struct bitmap *b, const char *name, size_t cnt)
+{
+  uint64_t start, fast_cycles, slow_cycles;
+  size_t fast_idx = 0, slow_idx = 0;
+  size_t fast_cnt = 0, slow_cnt = 0;
+  int i;
+
+  start = cycles ();
+  for (i = 0; i < REPEAT_CNT; i++)
+    fast_idx = bitmap_scan (b, 0, cnt, false);
+  fast_cycles = (cycles () - start) / REPEAT_CNT;
+
+  start = cycles ();
+  for (i = 0; i < REPEAT_CNT; i++)
+    slow_idx = slow_scan (b, 0, cnt, false);
+  slow_cycles = (cycles () - start) / REPEAT_CNT;
+
+  if (fast_idx != slow_idx)
+    PANIC ("%s: bitmap_scan returned %zu, expected %zu",
+           name, fast_idx, slow_idx);
+  printf ("%-24s scan %4zu: %12"PRIu64" %12"PRIu64" cycles\n",
+          name, cnt, fast_cycles, slow_cycles);
+
+  start = cycles ();
+  for (i = 0; i < REPEAT_CNT; i++)
+    fast_cnt = bitmap_count (b, 0, b->bit_cnt, false);
+  fast_cycles = (cycles () - start) / REPEAT_CNT;
+
+  start = cycles ();
+  for (i = 0; i < REPEAT_CNT; i++)
+    slow_cnt = slow_count (b, 0, b->bit_cnt, false);
+  slow_cycles = (cycles () - start) / REPEAT_CNT;
+
+  if (fast_cnt != slow_cnt)
+    PANIC ("%s: bitmap_count returned %zu, expected %zu",
+           name, fast_cnt, slow_cnt);
+  printf ("%-24s count:     %12"PRIu64" %12"PRIu64" cycles\n",
+          name, fast_cycles, slow_cycles);
+}
+
+/* Checks bitmap_scan(), bitmap_count(), bitmap_contains() and
+   bitmap_set_multiple() against the bit-by-bit versions at
+   random places in B and A, which must be the same size. */
+static void
+check_random (struct bitmap *a, struct bitmap *b)
+{
+  int i;
+
+  fill (a, 3);
+  memcpy (b->bits, a->bits, byte_cnt (a->bit_cnt));
+  for (i = 0; i < 20000; i++)
+    {
+      size_t start = random_ulong () % a->bit_cnt;
+      size_t cnt = random_ulong () % (a->bit_cnt - start) % 300;
+      bool value = random_ulong () % 2;
+
+      ASSERT (bitmap_scan (a, start, cnt % 12, value)
+              == slow_scan (a, start, cnt % 12, value));
+      ASSERT (bitmap_count (a, start, cnt, value)
+              == slow_count (a, start, cnt, value));
+      ASSERT (bitmap_contains (a, start, cnt, value)
+              == slow_contains (a, start, cnt, value));
+      bitmap_set_multiple (a, start, cnt, value);
+      slow_set_multiple (b, start, cnt, value);
+      ASSERT (!memcmp (a->bits, b->bits, byte_cnt (a->bit_cnt)));
+    }
+}
+
+int
+main (void)
+{
+  struct bitmap *a = bitmap_create (BIT_CNT);
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  uint64_t start, fast_cycles, slow_cycles;
+  int i;
+
+  ASSERT (a != NULL && b != NULL);
+  random_init (0);
+
+  printf ("%-24s %10s %12s %12s\n", "bitmap", "", "word", "bit");
+  fill (a, 0);
+  bench_scan (a, "full", 1);
+  fill (a, 0);
+  bitmap_reset (a, BIT_CNT - 1);
+  bench_scan (a, "full, last bit clear", 1);
+  fill (a, 1000);
+  bench_scan (a, "1 in 1000 clear", 1);
+  bench_scan (a, "1 in 1000 clear", 2);
+  fill (a, 8);
+  bench_scan (a, "1 in 8 clear", 2);
+
+  start = cycles ();
+  for (i = 0; i < REPEAT_CNT; i++)
+    bitmap_set_multiple (a, 3, BIT_CNT - 6, i % 2);
+  fast_cycles = (cycles () - start) / REPEAT_CNT;
+  start = cycles ();
+  for (i = 0; i < REPEAT_CNT; i++)
+    slow_set_multiple (a, 3, BIT_CNT - 6, i % 2);
+  slow_cycles = (cycles () - start) / REPEAT_CNT;
+  printf ("%-24s set:       %12"PRIu64" %12"PRIu64" cycles\n",
+          "whole map", fast_cycles, slow_cycles);
+
+  check_random (a, b);
+  printf ("random checks passed\n");
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* Test program for filesys/directory.c.
+
+   Creates enough files in the root directory for it to get a
+   hash index and to overflow the dentry cache, removes every
+   third one, and then checks through a freshly opened directory
+   that lookups find exactly the files that remain and that
+   dir_readdir() lists each of them once.  Finally, creates and
+   removes files over and over and checks that the directory
+   reuses the entries they free instead of growing.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/test.h"
+
+/* Number of files.  More than a directory needs for a hash
+   index, and more than the dentry cache holds. */
+#define FILE_CNT 400
+
+/* Number of times to create and remove files at the end. */
+#define ROUND_CNT 1000
+
+static bool present[FILE_CNT];
+
+static void make_name (char name[NAME_MAX + 1], int i);
+static void check_lookups (void);
+static void check_readdir (void);
+
+/* Runs the test. */
+void
+test (void)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  off_t length;
+  int i, round;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      make_name (name, i);
+      ASSERT (filesys_create (name, 0));
+      present[i] = true;
+    }
+  for (i = 0; i < FILE_CNT; i += 3)
+    {
+      make_name (name, i);
+      ASSERT (filesys_remove (name));
+      present[i] = false;
+    }
+  check_lookups ();
+  check_readdir ();
+
+  /* Every file created from here on fits in an entry freed by
+     one removed above, so the directory must not grow. */
+  dir = dir_open_root ();
+  ASSERT (dir != NULL);
+  length = inode_length (dir_get_inode (dir));
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      i = round % FILE_CNT / 3 * 3;
+      make_name (name, i);
+      ASSERT (filesys_create (name, 0));
+      ASSERT (filesys_remove (name));
+      ASSERT (filesys_create ("tmp", 0));
+      ASSERT (filesys_remove ("tmp"));
+    }
+  if (inode_length (dir_get_inode (dir)) != length)
+    PANIC ("directory grew from %d to %d bytes",
+           length, inode_length (dir_get_inode (dir)));
+  dir_close (dir);
+  check_lookups ();
+  check_readdir ();
+
+  for (i = 0; i < FILE_CNT; i++)
+    if (present[i])
+      {
+        make_name (name, i);
+        ASSERT (filesys_remove (name));
+      }
+
+  printf ("directory: PASS\n");
+}
+
+/* Stores the name of file I in NAME. */
+static void
+make_name (char name[NAME_MAX + 1], int i)
+{
+  snprintf (name, NAME_MAX + 1, "file%d", i);
+}
+
+/* Checks that a lookup of every file's name in a newly opened
+   root directory succeeds if and only if the file is present. */
+static void
+check_lookups (void)
+{
+  struct dir *dir = dir_open_root ();
+  int i;
+
+  ASSERT (dir != NULL);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[NAME_MAX + 1];
+      struct inode *inode;
+
+      make_name (name, i);
+      if (dir_lookup (dir, name, &inode) != present[i])
+        PANIC ("lookup of \"%s\" %s", name,
+               present[i] ? "failed" : "succeeded");
+      inode_close (inode);
+    }
+  dir_close (dir);
+}
+
+/* Checks that dir_readdir() on a newly opened root directory
+   lists every present file once and nothing else. */
+static void
+check_readdir (void)
+{
+  static bool seen[FILE_CNT];
+  char name[NAME_MAX + 1];
+  struct dir *dir = dir_open_root ();
+  int i;
+
+  ASSERT (dir != NULL);
+  memset (seen, 0, sizeof seen);
+  while (dir_readdir (dir, name))
+    {
+      /* Skip whatever else is in the root directory. */
+      if (memcmp (name, "file", 4))
+        continue;
+      i = atoi (name + 4);
+      if (i < 0 || i >= FILE_CNT || !present[i] || seen[i])
+        PANIC ("readdir returned \"%s\" unexpectedly", name);
+      seen[i] = true;
+    }
+  for (i = 0; i < FILE_CNT; i++)
+    if (present[i] && !seen[i])
+      PANIC ("readdir did not return \"file%d\"", i);
+  dir_close (dir);
+}
@@ -0,0 +1,443 @@
+/* Crash test for filesys/journal.c and the buffer cache's group
+   commit in filesys/cache.c.
+
+   Unlike most of the programs here, this one runs on the host
+   rather than inside Pintos.  It includes cache.c and journal.c
+   directly and gives them a file system device that is an array
+   in memory and that can be made to stop accepting writes after
+   any number of them, as if the machine had lost power.
+
+   For every such crash point in turn, it formats the journal,
+   commits one version of a set of metadata sectors along with a
+   data sector, then starts committing a second version and
+   crashes partway through.  After a "reboot", which forgets the
+   contents of the cache, journal_init() replays the journal.
+   The metadata must then be entirely the first version if the
+   crash came before the journal's commit record was written, and
+   entirely the second version, with the second version of the
+   data, if it came after.
+
+   Then it does the same for an operation, bracketed by
+   journal_begin() and journal_end(), that changes two sectors,
+   except that the commit starts after the first change and
+   before the second.  The commit must wait for the operation to
+   end, so that after the crash both sectors hold either their
+   old contents or their new ones.  Since this program has only
+   one thread, the rest of the operation runs when the commit
+   would block waiting for it.
+
+   To build and run it from the "src" directory:
+
+        gcc -m32 -O2 -DFILESYS -nostdinc -Ilib -Ilib/kernel -I. \
+            tests/internal/journal.c lib/kernel/hash.c lib/kernel/list.c \
+            -o journal-test && ./journal-test
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include "filesys/cache.c"
+#include "filesys/journal.c"
+
+#include <stdarg.h>
+
+/* From the host's C library, which Pintos's headers lack. */
+void exit (int) NO_RETURN;
+
+/* Sectors in the simulated device. */
+#define DISK_SECTORS 512
+
+/* Metadata sectors committed in each version, and where. */
+#define META_SECTOR 100
+#define META_CNT 40
+
+/* Data sector written along with the metadata. */
+#define DATA_SECTOR 300
+
+/* First of the two sectors changed by one operation. */
+#define OP_SECTOR 200
+
+/* Most crash points to try.  Each version's commit takes fewer
+   writes than this. */
+#define CRASH_MAX 200
+
+/* The simulated device. */
+static uint8_t disk[DISK_SECTORS][BLOCK_SECTOR_SIZE];
+struct block *fs_device;
+
+/* Number of writes the device accepts before crashing, or -1 to
+   accept all of them, and where to go when it crashes. */
+static int writes_left = -1;
+static void *crash_buf[5];
+
+/* Set once a journal header that commits a transaction has
+   reached the device. */
+static bool committed;
+
+/* The thread that runs the operation and the one that commits,
+   and which of them is running.  Both run on this program's only
+   thread, which switches to what the other would do next,
+   OTHER_THREAD, if the one running has to wait for it. */
+static struct thread worker, committer;
+static struct thread *running = &worker;
+static void (*other_thread) (void);
+
+static void test_commit (void);
+static void test_operation (void);
+static void report (const char *what, int before, int after);
+static void reboot (void);
+static void write_version (int version);
+static int read_version (void);
+static void write_op_sector (int i, int version);
+static void finish_operation (void);
+static int read_op_version (void);
+
+/* Runs the test. */
+int
+main (void)
+{
+  cache_init ();
+  test_commit ();
+  test_operation ();
+  return 0;
+}
+
+/* Crashes while committing a second version of every metadata
+   sector. */
+static void
+test_commit (void)
+{
+  int crash_point, before = 0, after = 0;
+
+  for (crash_point = 0; crash_point < CRASH_MAX; crash_point++)
+    {
+      bool crashed;
+      int version;
+
+      memset (disk, 0, sizeof disk);
+      reboot ();
+      journal_init (true);
+      write_version ('A');
+      cache_flush ();
+
+      committed = false;
+      writes_left = crash_point;
+      crashed = __builtin_setjmp (crash_buf) != 0;
+      if (!crashed)
+        {
+          write_version ('B');
+          cache_flush ();
+        }
+      writes_left = -1;
+
+      reboot ();
+      journal_init (false);
+      version = read_version ();
+      if (version != (committed ? 'B' : 'A'))
+        {
+          printf ("crash after %d writes: metadata is %s after replay, "
+                  "expected version %c\n", crash_point,
+                  version < 0 ? "torn" : version == 'A' ? "version A"
+                  : "version B", committed ? 'B' : 'A');
+          exit (1);
+        }
+      if (committed && memcmp (disk[DATA_SECTOR], "dataB", 6))
+        {
+          printf ("crash after %d writes: committed metadata without "
+                  "its data\n", crash_point);
+          exit (1);
+        }
+
+      if (committed)
+        after++;
+      else
+        before++;
+      if (!crashed)
+        break;
+    }
+  report ("commit", before, after);
+}
+
+/* Crashes while committing an operation that changed one sector
+   before the commit began and another after. */
+static void
+test_operation (void)
+{
+  int crash_point, before = 0, after = 0;
+
+  for (crash_point = 0; crash_point < CRASH_MAX; crash_point++)
+    {
+      bool crashed;
+      int version;
+
+      memset (disk, 0, sizeof disk);
+      reboot ();
+      journal_init (true);
+      journal_begin ();
+      write_op_sector (0, 'A');
+      write_op_sector (1, 'A');
+      journal_end ();
+      cache_flush ();
+
+      committed = false;
+      writes_left = crash_point;
+      crashed = __builtin_setjmp (crash_buf) != 0;
+      if (!crashed)
+        {
+          journal_begin ();
+          write_op_sector (0, 'B');
+          running = &committer;
+          other_thread = finish_operation;
+          cache_flush ();
+          running = &worker;
+          if (other_thread != NULL)
+            {
+              printf ("commit did not wait for the open operation\n");
+              exit (1);
+            }
+        }
+      writes_left = -1;
+
+      reboot ();
+      journal_init (false);
+      version = read_op_version ();
+      if (version != (committed ? 'B' : 'A'))
+        {
+          printf ("crash after %d writes: operation is %s after replay, "
+                  "expected version %c\n", crash_point,
+                  version < 0 ? "torn" : version == 'A' ? "version A"
+                  : "version B", committed ? 'B' : 'A');
+          exit (1);
+        }
+
+      if (committed)
+        after++;
+      else
+        before++;
+      if (!crashed)
+        break;
+    }
+  report ("operation", before, after);
+}
+
+/* Reports that the crash test named WHAT found BEFORE crash
+   points before the commit record and AFTER after it, or fails
+   if either is 0. */
+static void
+report (const char *what, int before, int after)
+{
+  if (before == 0 || after == 0)
+    {
+      printf ("%s: no crash points %s the commit record\n", what,
+              before == 0 ? "before" : "after");
+      exit (1);
+    }
+  printf ("journal: %s: %d crash points before the commit record and "
+          "%d after it all replayed consistently\n", what, before, after);
+}
+
+/* Forgets everything in the buffer cache without writing it
+   back, as a reboot would. */
+static void
+reboot (void)
+{
+  memset (cache, 0, sizeof cache);
+  clock_hand = 0;
+  worker.journal_depth = committer.journal_depth = 0;
+  running = &worker;
+  other_thread = NULL;
+}
+
+/* Writes VERSION to every metadata sector, and a matching
+   version of the data sector, through the buffer cache. */
+static void
+write_version (int version)
+{
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  char data[BLOCK_SECTOR_SIZE];
+  int i;
+
+  for (i = 0; i < META_CNT; i++)
+    {
+      memset (buffer, version, sizeof buffer);
+      buffer[0] = i;
+      cache_write_meta (META_SECTOR + i, buffer);
+    }
+  memset (data, 0, sizeof data);
+  snprintf (data, sizeof data, "data%c", version);
+  cache_write (DATA_SECTOR, data);
+}
+
+/* Returns the version that every metadata sector on the device
+   holds, or -1 if they do not all hold the same one. */
+static int
+read_version (void)
+{
+  int version = disk[META_SECTOR][1];
+  int i;
+
+  for (i = 0; i < META_CNT; i++)
+    if (disk[META_SECTOR + i][0] != i
+        || disk[META_SECTOR + i][1] != version)
+      return -1;
+  return version;
+}
+
+/* Writes VERSION to sector I of the two that the operation
+   changes. */
+static void
+write_op_sector (int i, int version)
+{
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+
+  memset (buffer, version, sizeof buffer);
+  cache_write_meta (OP_SECTOR + i, buffer);
+}
+
+/* Finishes the operation that the commit has to wait for. */
+static void
+finish_operation (void)
+{
+  struct thread *t = running;
+
+  running = &worker;
+  write_op_sector (1, 'B');
+  journal_end ();
+  running = t;
+}
+
+/* Returns the version that both of the operation's sectors hold
+   on the device, or -1 if they differ. */
+static int
+read_op_version (void)
+{
+  int version = disk[OP_SECTOR][0];
+
+  return disk[OP_SECTOR + 1][0] == version ? version : -1;
+}
+
+/* Writes BUFFER to SECTOR of the simulated device, unless it has
+   crashed. */
+static void
+device_write (block_sector_t sector, const void *buffer)
+{
+  ASSERT (sector < DISK_SECTORS);
+  if (writes_left == 0)
+    __builtin_longjmp (crash_buf, 1);
+  if (writes_left > 0)
+    writes_left--;
+  memcpy (disk[sector], buffer, BLOCK_SECTOR_SIZE);
+  if (sector == JOURNAL_SECTOR
+      && ((const struct journal_header *) buffer)->cnt > 0)
+    committed = true;
+}
+
+/* The functions that cache.c and journal.c need from the rest of
+   Pintos.  Everything runs in one thread, and the device
+   finishes every request as soon as it is submitted. */
+
+struct thread *
+thread_current (void)
+{
+  return running;
+}
+
+void
+debug_panic (const char *file, int line, const char *function,
+             const char *message, ...)
+{
+  va_list args;
+
+  printf ("PANIC at %s:%d in %s(): ", file, line, function);
+  va_start (args, message);
+  vprintf (message, args);
+  va_end (args);
+  printf ("\n");
+  exit (1);
+}
+
+void
+block_read (struct block *block UNUSED, block_sector_t sector,
+            void *buffer)
+{
+  ASSERT (sector < DISK_SECTORS);
+  memcpy (buffer, disk[sector], BLOCK_SECTOR_SIZE);
+}
+
+void
+block_write (struct block *block UNUSED, block_sector_t sector,
+             const void *buffer)
+{
+  device_write (sector, buffer);
+}
+
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  if (r->write)
+    device_write (r->sector, r->buffer);
+  else
+    block_read (block, r->sector, r->buffer);
+  if (r->complete != NULL)
+    r->complete (r, r->aux);
+}
+
+void
+block_wait (struct block_request *r UNUSED)
+{
+}
+
+void
+lock_init (struct lock *lock UNUSED)
+{
+}
+
+void
+lock_acquire (struct lock *lock UNUSED)
+{
+}
+
+void
+lock_release (struct lock *lock UNUSED)
+{
+}
+
+bool
+lock_held_by_current_thread (const struct lock *lock UNUSED)
+{
+  return true;
+}
+
+void
+cond_init (struct condition *cond UNUSED)
+{
+}
+
+void
+cond_wait (struct condition *cond UNUSED, struct lock *lock UNUSED)
+{
+  void (*run) (void) = other_thread;
+
+  if (run == NULL)
+    PANIC ("would wait forever");
+  other_thread = NULL;
+  run ();
+}
+
+void
+cond_broadcast (struct condition *cond UNUSED, struct lock *lock UNUSED)
+{
+}
+
+tid_t
+thread_create (const char *name UNUSED, int priority UNUSED,
+               thread_func *function UNUSED, void *aux UNUSED)
+{
+  return 1;
+}
+
+void
+timer_sleep (int64_t ticks UNUSED)
+{
+}
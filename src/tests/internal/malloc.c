@@ -0,0 +1,137 @@
+/* Microbenchmark for threads/malloc.c and threads/slab.c.
+
+   Allocates batches of objects of various sizes, frees them in
+   random order, and reports how many timer ticks malloc() and a
+   slab cache each take to do so, along with how many objects of
+   each size fit in a page.  Objects are filled and checked along
+   the way, so that overlapping allocations are caught too.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Objects allocated before any are freed. */
+#define BATCH_CNT 256
+
+/* Number of batches per object size. */
+#define ROUND_CNT 200
+
+static void shuffle (void *[], size_t);
+static void fill (void *, size_t, int);
+static void check (const void *, size_t, int);
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  static const size_t sizes[] = {16, 20, 24, 48, 100, 200, 500, 1000};
+  static struct slab_cache caches[sizeof sizes / sizeof *sizes];
+  static void *objects[BATCH_CNT];
+  size_t i;
+
+  printf ("%6s %10s %10s %12s %12s\n",
+          "size", "malloc", "slab", "malloc/page", "slab/page");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i];
+      size_t malloc_per_page;
+      struct slab_cache *cache = &caches[i];
+      int64_t start, malloc_ticks, slab_ticks;
+      int round;
+      size_t j;
+
+      /* malloc() rounds up to a power of 2, but no less than 16. */
+      for (malloc_per_page = 16; malloc_per_page < size; )
+        malloc_per_page *= 2;
+      malloc_per_page = (PGSIZE - 12) / malloc_per_page;
+
+      start = timer_ticks ();
+      for (round = 0; round < ROUND_CNT; round++)
+        {
+          for (j = 0; j < BATCH_CNT; j++)
+            {
+              objects[j] = malloc (size);
+              ASSERT (objects[j] != NULL);
+              fill (objects[j], size, j);
+            }
+          for (j = 0; j < BATCH_CNT; j++)
+            check (objects[j], size, j);
+          shuffle (objects, BATCH_CNT);
+          for (j = 0; j < BATCH_CNT; j++)
+            free (objects[j]);
+        }
+      malloc_ticks = timer_elapsed (start);
+
+      slab_cache_init (cache, "bench", size, NULL);
+      start = timer_ticks ();
+      for (round = 0; round < ROUND_CNT; round++)
+        {
+          for (j = 0; j < BATCH_CNT; j++)
+            {
+              objects[j] = slab_alloc (cache);
+              ASSERT (objects[j] != NULL);
+              fill (objects[j], size, j);
+            }
+          for (j = 0; j < BATCH_CNT; j++)
+            check (objects[j], size, j);
+          shuffle (objects, BATCH_CNT);
+          for (j = 0; j < BATCH_CNT; j++)
+            slab_free (cache, objects[j]);
+        }
+      slab_ticks = timer_elapsed (start);
+
+      printf ("%6zu %10"PRId64" %10"PRId64" %12zu %12zu\n",
+              size, malloc_ticks, slab_ticks, malloc_per_page,
+              cache->objects_per_slab);
+    }
+
+  /* Every slab is empty now, so reaping must give back at least
+     one page per cache. */
+  ASSERT (slab_reap () >= sizeof sizes / sizeof *sizes);
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (void *array[], size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      void *t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Fills the SIZE bytes at P with a pattern based on VALUE. */
+static void
+fill (void *p, size_t size, int value)
+{
+  memset (p, value & 0xff, size);
+}
+
+/* Checks that the SIZE bytes at P hold the pattern that fill()
+   wrote for VALUE. */
+static void
+check (const void *p_, size_t size, int value)
+{
+  const unsigned char *p = p_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    ASSERT (p[i] == (value & 0xff));
+}
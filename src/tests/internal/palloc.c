@@ -0,0 +1,132 @@
+/* Test program for threads/palloc.c.
+
+   Allocates blocks of random sizes from both pools until they
+   are exhausted, checking that no two blocks overlap, then frees
+   them in random order and checks that the buddy allocator has
+   merged every pool back into the blocks it started with.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Largest order of block to request. */
+#define MAX_ORDER 6
+
+/* An allocated block.  Stored at the start of the block itself,
+   so that the test needs no memory of its own. */
+struct chunk
+  {
+    struct chunk *next;         /* Next allocated block. */
+    size_t page_cnt;            /* Number of pages. */
+    unsigned tag;               /* Written to every page. */
+  };
+
+static void exhaust_and_free (enum palloc_flags, const char *name);
+static void tag_pages (struct chunk *);
+static void check_pages (const struct chunk *);
+
+/* Tests the page allocator. */
+void
+test (void)
+{
+  exhaust_and_free (0, "kernel");
+  exhaust_and_free (PAL_USER, "user");
+}
+
+/* Allocates from the pool selected by FLAGS until it is empty,
+   then frees everything and compares fragmentation statistics
+   with what they were at the start.  Names the pool NAME in
+   messages. */
+static void
+exhaust_and_free (enum palloc_flags flags, const char *name)
+{
+  struct palloc_stats before, after;
+  struct chunk *chunks = NULL;
+  size_t chunk_cnt = 0;
+  size_t i;
+  int max_order, order;
+
+  palloc_get_stats (flags, &before);
+
+  /* Allocate random sizes, not only powers of 2, until even a
+     single page cannot be had. */
+  for (max_order = MAX_ORDER; max_order >= 0; )
+    {
+      size_t page_cnt;
+      struct chunk *c;
+
+      order = random_ulong () % (max_order + 1);
+      page_cnt = (size_t) 1 << order;
+      if (page_cnt > 1)
+        page_cnt -= random_ulong () % (page_cnt / 2);
+      c = palloc_get_multiple (flags, page_cnt);
+      if (c == NULL)
+        {
+          /* Stick to smaller blocks once large ones run out. */
+          max_order = order - 1;
+          continue;
+        }
+
+      c->next = chunks;
+      c->page_cnt = page_cnt;
+      c->tag = chunk_cnt;
+      tag_pages (c);
+      chunks = c;
+      chunk_cnt++;
+    }
+  palloc_get_stats (flags, &after);
+  ASSERT (after.free_cnt == 0);
+  printf ("%s pool: exhausted after %zu blocks\n", name, chunk_cnt);
+
+  /* Check every block, then free them in random order. */
+  for (; chunk_cnt > 0; chunk_cnt--)
+    {
+      struct chunk **cp = &chunks;
+      struct chunk *c;
+
+      for (i = random_ulong () % chunk_cnt; i > 0; i--)
+        cp = &(*cp)->next;
+      c = *cp;
+      *cp = c->next;
+      check_pages (c);
+      palloc_free_multiple (c, c->page_cnt);
+    }
+
+  palloc_get_stats (flags, &after);
+  ASSERT (after.free_cnt == before.free_cnt);
+  ASSERT (after.largest_free == before.largest_free);
+  for (order = 0; order < PALLOC_ORDER_CNT; order++)
+    ASSERT (after.block_cnt[order] == before.block_cnt[order]);
+  printf ("%s pool: all pages free and merged again\n", name);
+}
+
+/* Writes C's tag into the last word of each of its pages. */
+static void
+tag_pages (struct chunk *c)
+{
+  size_t i;
+
+  for (i = 0; i < c->page_cnt; i++)
+    *(unsigned *) ((uint8_t *) c + (i + 1) * PGSIZE - sizeof (unsigned))
+      = c->tag;
+}
+
+/* Checks that each of C's pages still holds its tag. */
+static void
+check_pages (const struct chunk *c)
+{
+  size_t i;
+
+  for (i = 0; i < c->page_cnt; i++)
+    ASSERT (*(const unsigned *) ((const uint8_t *) c + (i + 1) * PGSIZE
+                                 - sizeof (unsigned)) == c->tag);
+}
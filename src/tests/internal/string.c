@@ -0,0 +1,169 @@
+/* Benchmark for memcpy(), memset(), memcmp() and strlen() in
+   lib/string.c.
+
+   Times each routine on blocks from 1 byte to 64 kB, next to a
+   plain byte-at-a-time loop doing the same work, and prints the
+   average number of CPU cycles per call, as read by RDTSC.  The
+   results of each routine are checked against the loop's.
+
+   The same code runs in the kernel, through test() like the
+   other programs here, and as the user program
+   tests/userprog/bench-string, which uses the user C library:
+
+        pintos -p tests/userprog/bench-string -a bench-string \
+               -- -q -f run bench-string
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+void test (void);
+
+/* Largest block size. */
+#define MAX_SIZE (64 * 1024)
+
+/* Calls per size.  Small sizes are repeated more, so that every
+   size takes roughly as long. */
+#define REPEAT_CNT(SIZE) ((SIZE) < 1024 ? 256 : 16)
+
+static unsigned char src[MAX_SIZE + 1];
+static unsigned char dst[MAX_SIZE + 1];
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+cycles (void)
+{
+  return __builtin_ia32_rdtsc ();
+}
+
+/* Byte-at-a-time versions, as lib/string.c did them before.
+   The empty asm statements keep the compiler from recognizing
+   the loops and turning them back into library calls. */
+
+static void
+byte_memcpy (unsigned char *d, const unsigned char *s, size_t size)
+{
+  while (size-- > 0)
+    {
+      *d++ = *s++;
+      asm volatile ("");
+    }
+}
+
+static void
+byte_memset (unsigned char *d, int value, size_t size)
+{
+  while (size-- > 0)
+    {
+      *d++ = value;
+      asm volatile ("");
+    }
+}
+
+static int
+byte_memcmp (const unsigned char *a, const unsigned char *b, size_t size)
+{
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+static size_t
+byte_strlen (const unsigned char *s)
+{
+  const unsigned char *p;
+
+  for (p = s; *p != '\0'; p++)
+    asm volatile ("");
+  return p - s;
+}
+
+/* Prints the cycles per call of the library routine, LIB_CYCLES
+   in total, and of the byte loop, BYTE_CYCLES in total, for
+   blocks of SIZE bytes, naming the routine NAME. */
+static void
+report (const char *name, size_t size, uint64_t lib_cycles,
+        uint64_t byte_cycles)
+{
+  printf ("%-8s %6zu: %10"PRIu64" %10"PRIu64"\n", name, size,
+          lib_cycles / REPEAT_CNT (size), byte_cycles / REPEAT_CNT (size));
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  size_t size;
+  size_t i;
+
+  for (i = 0; i < MAX_SIZE; i++)
+    src[i] = 'a' + i % 26;
+  src[MAX_SIZE] = '\0';
+
+  printf ("%-8s %6s  %10s %10s\n", "routine", "size", "string.c", "bytes");
+  for (size = 1; size <= MAX_SIZE; size *= 2)
+    {
+      uint64_t start, lib_cycles, byte_cycles;
+      int result = 0;
+      size_t length = 0;
+      int j;
+
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        memcpy (dst, src, size);
+      lib_cycles = cycles () - start;
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        byte_memcpy (dst, src, size);
+      byte_cycles = cycles () - start;
+      ASSERT (!memcmp (dst, src, size));
+      report ("memcpy", size, lib_cycles, byte_cycles);
+
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        memset (dst, 'x', size);
+      lib_cycles = cycles () - start;
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        byte_memset (dst, 'x', size);
+      byte_cycles = cycles () - start;
+      for (i = 0; i < size; i++)
+        ASSERT (dst[i] == 'x');
+      report ("memset", size, lib_cycles, byte_cycles);
+
+      /* Compare equal blocks, the worst case. */
+      memcpy (dst, src, size);
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        result |= memcmp (dst, src, size);
+      lib_cycles = cycles () - start;
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        result |= byte_memcmp (dst, src, size);
+      byte_cycles = cycles () - start;
+      ASSERT (result == 0);
+      report ("memcmp", size, lib_cycles, byte_cycles);
+
+      /* Measure a string of SIZE - 1 characters. */
+      dst[size - 1] = '\0';
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        length += strlen ((const char *) dst);
+      lib_cycles = cycles () - start;
+      start = cycles ();
+      for (j = 0; j < REPEAT_CNT (size); j++)
+        length -= byte_strlen (dst);
+      byte_cycles = cycles () - start;
+      ASSERT (length == 0);
+      ASSERT (strlen ((const char *) dst) == size - 1);
+      report ("strlen", size, lib_cycles, byte_cycles);
+    }
+}
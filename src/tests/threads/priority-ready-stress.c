@@ -0,0 +1,120 @@
+/* Puts 500 threads, spread across every priority below the main
+   thread's, into the ready queue at once, ROUNDS times over.
+   Each round wakes all of them from a single semaphore with
+   interrupts disabled, which is the path that inserts threads
+   into the ready queue, and then checks that every one of them
+   ran, highest priority first.
+
+   Also reports the timer ticks that elapse while interrupts are
+   off for the wakeups, and the CPU cycles that takes, as read by
+   RDTSC.  Those depend on the machine, so they are only printed,
+   not checked. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 500
+#define ROUNDS 20
+
+static struct semaphore go;
+static struct semaphore done;
+
+/* Priorities of the workers in the order they ran this round. */
+static int run_order[THREAD_CNT];
+static int run_cnt;
+
+static thread_func ready_thread;
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+cycles (void)
+{
+  return __builtin_ia32_rdtsc ();
+}
+
+void
+test_priority_ready_stress (void) 
+{
+  int64_t off_ticks = 0;
+  uint64_t off_cycles = 0;
+  int round, i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Keep the main thread above every worker so that none of
+     them runs until it blocks. */
+  thread_set_priority (PRI_MAX);
+
+  sema_init (&go, 0);
+  sema_init (&done, 0);
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "ready %d", i);
+      thread_create (name, PRI_MIN + i % (PRI_MAX - PRI_MIN), ready_thread,
+                     NULL);
+    }
+
+  /* Wait for every worker to block on GO. */
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  msg ("%d threads ready at once, %d rounds.", THREAD_CNT, ROUNDS);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      enum intr_level old_level;
+      uint64_t start_cycles;
+      int64_t start;
+
+      run_cnt = 0;
+      start = timer_ticks ();
+      old_level = intr_disable ();
+      start_cycles = cycles ();
+      for (i = 0; i < THREAD_CNT; i++)
+        sema_up (&go);
+      off_cycles += cycles () - start_cycles;
+      intr_set_level (old_level);
+      off_ticks += timer_elapsed (start);
+
+      for (i = 0; i < THREAD_CNT; i++)
+        sema_down (&done);
+
+      if (run_cnt != THREAD_CNT)
+        fail ("round %d: %d of %d threads ran",
+              round, run_cnt, THREAD_CNT);
+      for (i = 1; i < THREAD_CNT; i++)
+        if (run_order[i] > run_order[i - 1])
+          fail ("round %d: priority %d thread ran after priority %d",
+                round, run_order[i], run_order[i - 1]);
+    }
+
+  msg ("every thread ran in priority order in every round");
+  msg ("interrupts off for %"PRId64" ticks in all, "
+       "%"PRIu64" cycles per round", off_ticks, off_cycles / ROUNDS);
+  pass ();
+}
+
+static void
+ready_thread (void *aux UNUSED) 
+{
+  int round;
+
+  sema_up (&done);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      enum intr_level old_level;
+
+      sema_down (&go);
+      old_level = intr_disable ();
+      run_order[run_cnt++] = thread_get_priority ();
+      intr_set_level (old_level);
+      sema_up (&done);
+    }
+}
@@ -0,0 +1,11 @@
+/* Times the user C library's string routines, with the
+   benchmark in tests/internal/string.c.  Not a graded test. */
+
+#include "tests/internal/string.c"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  test ();
+}
@@ -0,0 +1,65 @@
+/* Forks a child, which starts out sharing the parent's memory
+   copy-on-write.  The child must see the parent's data and open
+   file, at the same position, and its writes to either must not
+   be seen by the parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Spans several pages. */
+static char buf[3 * 4096 + 100];
+
+/* Fails unless all of BUF holds C. */
+static void
+check_buf (char c, const char *who) 
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != c)
+      fail ("%s: buf[%zu] is '%c', expected '%c'", who, i, buf[i], c);
+}
+
+/* Fails unless the next SIZE bytes read from HANDLE match
+   SAMPLE starting at OFS. */
+static void
+check_read (int handle, size_t ofs, size_t size, const char *who) 
+{
+  char block[32];
+
+  if (read (handle, block, size) != (int) size
+      || memcmp (block, sample + ofs, size))
+    fail ("%s: read of sample.txt at %zu does not match", who, ofs);
+}
+
+void
+test_main (void) 
+{
+  int handle;
+  pid_t pid;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  check_read (handle, 0, 10, "parent");
+  memset (buf, 'p', sizeof buf);
+
+  pid = fork ();
+  if (pid == 0) 
+    {
+      check_buf ('p', "child");
+      memset (buf, 'c', sizeof buf);
+      check_buf ('c', "child");
+      check_read (handle, 10, 20, "child");
+      msg ("child done");
+      exit (81);
+    }
+  if (pid < 0)
+    fail ("fork() failed");
+
+  CHECK (wait (pid) == 81, "wait(fork()) = 81");
+  check_buf ('p', "parent");
+  check_read (handle, 10, 20, "parent");
+  msg ("parent's memory and file position unchanged");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) open "sample.txt"
+(fork-cow) child done
+fork-cow: exit(81)
+(fork-cow) wait(fork()) = 81
+(fork-cow) parent's memory and file position unchanged
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -206,6 +206,28 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
+/* Returns true if external interrupt VEC_NO has been raised
+   but not yet delivered, which can happen only while interrupts
+   are off, by reading the PIC's interrupt request register. */
+bool
+intr_ext_pending (uint8_t vec_no) 
+{
+  int irq = vec_no - 0x20;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  if (irq < 8)
+    {
+      outb (PIC0_CTRL, 0x0a);   /* OCW3: read IRR on next read. */
+      return (inb (PIC0_CTRL) >> irq) & 1;
+    }
+  else
+    {
+      outb (PIC1_CTRL, 0x0a);   /* OCW3: read IRR on next read. */
+      return (inb (PIC1_CTRL) >> (irq - 8)) & 1;
+    }
+}
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
@@ -5,8 +5,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -28,6 +31,16 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
+   Each thread also keeps a "magazine" of free blocks for each
+   descriptor, a short stack that only it touches, so most
+   allocations and frees take no lock at all.  An empty magazine
+   is refilled with a batch of blocks from the descriptor's free
+   list, and a full one gives a batch back, under the
+   descriptor's lock.  A block in a magazine still counts as in
+   use by its arena, so an arena is only given back once every
+   one of its blocks is on the free list.  A thread's magazines
+   are emptied when it exits.
+
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
@@ -41,8 +54,20 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;   /* Blocks allocated. */
+    unsigned long long free_cnt;    /* Blocks freed. */
+    unsigned long long refill_cnt;  /* Magazines refilled. */
+    unsigned long long flush_cnt;   /* Magazines flushed. */
+    unsigned long long arena_cnt;   /* Arenas allocated. */
   };
 
+/* Most blocks a magazine holds, and the number moved at once
+   between a magazine and its descriptor's free list. */
+#define MAGAZINE_SIZE 16
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -54,18 +79,38 @@ struct arena
     size_t free_cnt;            /* Free blocks; pages in big block. */
   };
 
-/* Free block. */
+/* Free block.  A block in a magazine uses only the first word
+   of FREE_ELEM, to point to the next block in the magazine. */
 struct block 
   {
     struct list_elem free_elem; /* Free list element. */
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_CNT];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool refill (struct desc *, struct malloc_magazine *);
+static void flush (struct desc *, struct malloc_magazine *, size_t cnt);
+
+/* Returns the next block after B in a magazine. */
+static inline struct block **
+magazine_link (struct block *b)
+{
+  return (struct block **) b;
+}
+
+/* Adds 1 to statistic *CNT.  The common paths hold no lock, so
+   interrupts are turned off to keep the 64-bit update whole. */
+static inline void
+count (unsigned long long *cnt)
+{
+  enum intr_level old_level = intr_disable ();
+  (*cnt)++;
+  intr_set_level (old_level);
+}
 
 /* Initializes the malloc() descriptors. */
 void
@@ -82,6 +127,7 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  ASSERT (desc_cnt == MALLOC_CLASS_CNT);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -90,6 +136,7 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
+  struct malloc_magazine *mag;
   struct block *b;
   struct arena *a;
 
@@ -108,6 +155,8 @@ malloc (size_t size)
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
       a = palloc_get_multiple (0, page_cnt);
+      if (a == NULL && slab_reap () > 0)
+        a = palloc_get_multiple (0, page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -119,37 +168,16 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
-    {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
-    }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  /* Take a block from this thread's magazine, refilling it if
+     it is empty. */
+  ASSERT (!intr_context ());
+  mag = &thread_current ()->magazines[d - descs];
+  if (mag->cnt == 0 && !refill (d, mag))
+    return NULL;
+  b = mag->top;
+  mag->top = *magazine_link (b);
+  mag->cnt--;
+  count (&d->alloc_cnt);
   return b;
 }
 
@@ -223,6 +251,7 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+      struct malloc_magazine *mag;
       
       if (d != NULL) 
         {
@@ -233,26 +262,16 @@ free (void *p)
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
-
-          lock_release (&d->lock);
+          /* Put the block in this thread's magazine, first
+             making room if it is full. */
+          ASSERT (!intr_context ());
+          mag = &thread_current ()->magazines[d - descs];
+          if (mag->cnt >= MAGAZINE_SIZE)
+            flush (d, mag, MAGAZINE_BATCH);
+          *magazine_link (b) = mag->top;
+          mag->top = b;
+          mag->cnt++;
+          count (&d->free_cnt);
         }
       else
         {
@@ -263,6 +282,127 @@ free (void *p)
     }
 }
 
+/* Gives the blocks in the current thread's magazines back to
+   their descriptors.  Called when the thread exits. */
+void
+malloc_thread_exit (void) 
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    if (t->magazines[i].cnt > 0)
+      flush (&descs[i], &t->magazines[i], t->magazines[i].cnt);
+}
+
+/* Prints allocation statistics for each size class that has
+   been used. */
+void
+malloc_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      if (d->alloc_cnt > 0)
+        printf ("malloc: %zu-byte blocks: %llu allocs, %llu frees, "
+                "%llu refills, %llu flushes, %llu arenas\n",
+                d->block_size, d->alloc_cnt, d->free_cnt,
+                d->refill_cnt, d->flush_cnt, d->arena_cnt);
+    }
+}
+
+/* Moves up to MAGAZINE_BATCH blocks from D's free list into
+   magazine MAG, which must be empty, creating new arenas as
+   needed.  Returns false if not even one block is available. */
+static bool
+refill (struct desc *d, struct malloc_magazine *mag) 
+{
+  ASSERT (mag->cnt == 0);
+
+  lock_acquire (&d->lock);
+  while (mag->cnt < MAGAZINE_BATCH)
+    {
+      struct block *b;
+      struct arena *a;
+
+      /* If the free list is empty, create a new arena. */
+      if (list_empty (&d->free_list))
+        {
+          size_t i;
+
+          /* Allocate a page, reclaiming empty slabs if there is
+             none.  Settle for what we have if that fails. */
+          a = palloc_get_page (0);
+          if (a == NULL && slab_reap () > 0)
+            a = palloc_get_page (0);
+          if (a == NULL) 
+            break;
+
+          /* Initialize arena and add its blocks to the free list. */
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_push_back (&d->free_list, &b->free_elem);
+            }
+          d->arena_cnt++;
+        }
+
+      /* Move a block from the free list to the magazine. */
+      b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+      a = block_to_arena (b);
+      a->free_cnt--;
+      *magazine_link (b) = mag->top;
+      mag->top = b;
+      mag->cnt++;
+    }
+  d->refill_cnt++;
+  lock_release (&d->lock);
+
+  return mag->cnt > 0;
+}
+
+/* Moves CNT blocks from magazine MAG to D's free list, giving
+   back to the page allocator any arena left entirely unused. */
+static void
+flush (struct desc *d, struct malloc_magazine *mag, size_t cnt) 
+{
+  ASSERT (cnt <= mag->cnt);
+
+  lock_acquire (&d->lock);
+  for (; cnt > 0; cnt--)
+    {
+      struct block *b = mag->top;
+      struct arena *a = block_to_arena (b);
+
+      mag->top = *magazine_link (b);
+      mag->cnt--;
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena) 
+        {
+          size_t i;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+        }
+    }
+  d->flush_cnt++;
+  lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -4,10 +4,24 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of size classes, for blocks of 16, 32, ..., 1024
+   bytes. */
+#define MALLOC_CLASS_CNT 7
+
+/* A thread's private stack of free blocks of one size class,
+   linked through the blocks themselves. */
+struct malloc_magazine
+  {
+    void *top;                  /* Most recently freed block. */
+    unsigned cnt;               /* Number of blocks. */
+  };
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_thread_exit (void);
+void malloc_print_stats (void);
 
 #endif /* threads/malloc.h */
@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +24,54 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free pages are
+   grouped into blocks of 2**ORDER pages, each aligned to its own
+   size relative to the start of the pool, and each order has a
+   list of its free blocks, linked through the blocks' first
+   pages.  A request for PAGE_CNT pages takes a block of the
+   smallest order that fits, splitting a larger one if needed,
+   and gives back the unused tail.  A freed block is merged with
+   its "buddy", the other half of the block of the next order up,
+   for as long as the buddy is free too.  So a single page comes
+   straight off the order-0 list when one is there, and nothing
+   takes more than a walk up and down the orders.
+
+   The pools are also changed with interrupts off rather than
+   under a lock, because thread_schedule_tail() frees the page of
+   a dying thread with interrupts already disabled. */
+
+/* Marks a page that does not start a free block. */
+#define NOT_FREE 0xff
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *free_order;                /* For each page, order of the
+                                           free block it starts, or
+                                           NOT_FREE. */
+    struct list free_lists[PALLOC_ORDER_CNT]; /* Free blocks by order. */
+    size_t free_cnt;                    /* Number of free pages. */
     uint8_t *base;                      /* Base of pool. */
   };
 
+/* A free block, at the start of its first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
+  };
+
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t take_block (struct pool *, int order);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,15 +104,30 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
+  int order;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* Find the smallest order that holds PAGE_CNT pages. */
+  for (order = 0; order < PALLOC_ORDER_CNT; order++)
+    if (((size_t) 1 << order) >= page_cnt)
+      break;
+
+  old_level = intr_disable ();
+  page_idx = order < PALLOC_ORDER_CNT ? take_block (pool, order) : BITMAP_ERROR;
+  if (page_idx != BITMAP_ERROR) 
+    {
+      /* Give back the pages past PAGE_CNT. */
+      free_range (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+      pool->free_cnt -= page_cnt;
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -118,6 +166,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +186,12 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +201,171 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Stores fragmentation statistics for the user pool in *STATS
+   if PAL_USER is set in FLAGS, otherwise for the kernel pool. */
+void
+palloc_get_stats (enum palloc_flags flags, struct palloc_stats *stats) 
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  int order;
+
+  old_level = intr_disable ();
+  stats->page_cnt = bitmap_size (pool->used_map);
+  stats->free_cnt = pool->free_cnt;
+  stats->largest_free = 0;
+  for (order = 0; order < PALLOC_ORDER_CNT; order++)
+    {
+      stats->block_cnt[order] = list_size (&pool->free_lists[order]);
+      if (stats->block_cnt[order] > 0)
+        stats->largest_free = (size_t) 1 << order;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints fragmentation statistics for both pools.  A pool's
+   fragmentation is the fraction of its free pages that are not
+   in its largest free block. */
+void
+palloc_print_stats (void) 
+{
+  static const char *names[] = {"kernel", "user"};
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      struct palloc_stats stats;
+      int order;
+
+      palloc_get_stats (i == 0 ? 0 : PAL_USER, &stats);
+      printf ("palloc: %s pool: %zu of %zu pages free, "
+              "largest free block %zu pages, %zu%% fragmented\n",
+              names[i], stats.free_cnt, stats.page_cnt, stats.largest_free,
+              (stats.free_cnt == 0 ? 0
+               : (stats.free_cnt - stats.largest_free) * 100
+                 / stats.free_cnt));
+      printf ("palloc: %s pool free blocks by order:", names[i]);
+      for (order = 0; order < PALLOC_ORDER_CNT; order++)
+        if (stats.block_cnt[order] > 0)
+          printf (" %d:%zu", order, stats.block_cnt[order]);
+      printf ("\n");
+    }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map at its base, followed by its
+     free_order map.  Calculate the space needed for them and
+     subtract it from the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, with every page free. */
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, NOT_FREE, page_cnt);
+  for (order = 0; order < PALLOC_ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = page_cnt;
+  free_range (p, 0, page_cnt);
+}
+
+/* Removes a free block of 2**ORDER pages from POOL and returns
+   the index of its first page, splitting a larger block if no
+   block of that order is free.  Returns BITMAP_ERROR if no free
+   block is large enough.  Must be called with interrupts off. */
+static size_t
+take_block (struct pool *pool, int order) 
+{
+  struct free_block *b;
+  size_t page_idx;
+  int j;
+
+  for (j = order; j < PALLOC_ORDER_CNT; j++)
+    if (!list_empty (&pool->free_lists[j]))
+      break;
+  if (j == PALLOC_ORDER_CNT)
+    return BITMAP_ERROR;
+
+  b = list_entry (list_pop_front (&pool->free_lists[j]),
+                  struct free_block, elem);
+  page_idx = pg_no (b) - pg_no (pool->base);
+  ASSERT (pool->free_order[page_idx] == j);
+  pool->free_order[page_idx] = NOT_FREE;
+
+  /* Put the upper halves back until the block is the right
+     size. */
+  while (j > order)
+    {
+      j--;
+      b = (struct free_block *) (pool->base
+                                 + (page_idx + ((size_t) 1 << j)) * PGSIZE);
+      pool->free_order[page_idx + ((size_t) 1 << j)] = j;
+      list_push_front (&pool->free_lists[j], &b->elem);
+    }
+  return page_idx;
+}
+
+/* Adds the block of 2**ORDER pages starting at PAGE_IDX to
+   POOL's free lists, merging it with its buddy as long as the
+   buddy is free.  Must be called with interrupts off. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+  struct free_block *b;
+
+  while (order < PALLOC_ORDER_CNT - 1)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > page_cnt
+          || pool->free_order[buddy] != order)
+        break;
+
+      b = (struct free_block *) (pool->base + buddy * PGSIZE);
+      list_remove (&b->elem);
+      pool->free_order[buddy] = NOT_FREE;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  b = (struct free_block *) (pool->base + page_idx * PGSIZE);
+  pool->free_order[page_idx] = order;
+  list_push_front (&pool->free_lists[order], &b->elem);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   fewest blocks that are aligned to their own size.  Must be
+   called with interrupts off. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < PALLOC_ORDER_CNT - 1
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -11,10 +11,25 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Number of block sizes in the buddy allocator, which hands out
+   blocks of 1, 2, 4, ..., 2**(PALLOC_ORDER_CNT - 1) pages. */
+#define PALLOC_ORDER_CNT 20
+
+/* Fragmentation statistics for a pool. */
+struct palloc_stats
+  {
+    size_t page_cnt;                    /* Pages in pool. */
+    size_t free_cnt;                    /* Free pages. */
+    size_t largest_free;                /* Pages in largest free block. */
+    size_t block_cnt[PALLOC_ORDER_CNT]; /* Free blocks of each order. */
+  };
+
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_get_stats (enum palloc_flags, struct palloc_stats *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,261 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator, after Bonwick's "The Slab Allocator: An
+   Object-Caching Kernel Memory Allocator".
+
+   A slab cache hands out objects of a single size.  It takes
+   pages from the page allocator, called "slabs", and divides
+   each one into as many objects as fit after the slab header.
+   Objects are packed at their own size, rounded up only to a
+   multiple of 4 bytes, rather than to a power of 2 as malloc()
+   does, so a 20-byte object takes 20 bytes.
+
+   Each slab keeps a list of its free objects, threaded through
+   the objects themselves.  A cache keeps its slabs on three
+   lists: partial, full, and empty.  Allocation prefers partial
+   slabs, so that objects stay packed into as few pages as
+   possible, and a slab whose last object is freed moves to the
+   empty list instead of being freed right away, since it will
+   likely be wanted again soon.  When the page allocator runs out
+   of pages, slab_reap() gives every empty slab in every cache
+   back to it.
+
+   If a cache has a constructor, it is called on each object
+   once, when the object's slab is created, and freed objects are
+   expected to be returned to that initial state.  Such objects
+   get a separate word at the end of their slot for the free
+   link, so that freeing does not disturb them. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0bec
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    size_t in_use;              /* Number of objects in use. */
+    void *free;                 /* First free object, or null. */
+  };
+
+/* Offset of the first object within a slab. */
+#define SLAB_HEADER_SIZE ROUND_UP (sizeof (struct slab), sizeof (void *))
+
+/* All slab caches, for slab_reap(). */
+static struct list all_caches;
+static struct lock all_caches_lock;
+
+static struct slab *new_slab (struct slab_cache *);
+static struct slab *object_to_slab (struct slab_cache *, void *);
+
+/* Returns the location of the free link in OBJECT, which belongs
+   to cache C. */
+static inline void **
+free_link (struct slab_cache *c, void *object)
+{
+  return (void **) ((uint8_t *) object + c->link_ofs);
+}
+
+/* Initializes the slab allocator. */
+void
+slab_init (void)
+{
+  list_init (&all_caches);
+  lock_init (&all_caches_lock);
+}
+
+/* Initializes C as a cache of objects of SIZE bytes, named NAME
+   for debugging.  If CTOR is non-null, it is called on each
+   object when its slab is created. */
+void
+slab_cache_init (struct slab_cache *c, const char *name, size_t size,
+                 slab_ctor_func *ctor)
+{
+  ASSERT (size > 0);
+
+  c->name = name;
+  c->object_size = size;
+  c->ctor = ctor;
+  c->slot_size = ROUND_UP (size, sizeof (void *));
+  if (ctor != NULL)
+    {
+      c->link_ofs = c->slot_size;
+      c->slot_size += sizeof (void *);
+    }
+  else
+    c->link_ofs = 0;
+  ASSERT (c->slot_size <= PGSIZE - SLAB_HEADER_SIZE);
+  c->objects_per_slab = (PGSIZE - SLAB_HEADER_SIZE) / c->slot_size;
+
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+
+  lock_acquire (&all_caches_lock);
+  list_push_back (&all_caches, &c->elem);
+  lock_release (&all_caches_lock);
+}
+
+/* Obtains and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *c)
+{
+  struct slab *s;
+  void *object;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial) && list_empty (&c->empty))
+    {
+      /* Don't hold the lock while calling into the page
+         allocator, which may reap this cache. */
+      lock_release (&c->lock);
+      s = new_slab (c);
+      if (s == NULL)
+        return NULL;
+      lock_acquire (&c->lock);
+      list_push_back (&c->empty, &s->elem);
+    }
+
+  /* Fill partial slabs before starting on empty ones. */
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else
+    s = list_entry (list_front (&c->empty), struct slab, elem);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->free != NULL);
+
+  object = s->free;
+  s->free = *free_link (c, object);
+  list_remove (&s->elem);
+  if (++s->in_use == c->objects_per_slab)
+    list_push_back (&c->full, &s->elem);
+  else
+    list_push_front (&c->partial, &s->elem);
+  lock_release (&c->lock);
+
+  return object;
+}
+
+/* Returns OBJECT, which must have been obtained from cache C
+   with slab_alloc(), to C. */
+void
+slab_free (struct slab_cache *c, void *object)
+{
+  struct slab *s;
+
+  if (object == NULL)
+    return;
+  s = object_to_slab (c, object);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it is supposed to keep its constructed state. */
+  if (c->ctor == NULL)
+    memset (object, 0xcc, c->object_size);
+#endif
+
+  lock_acquire (&c->lock);
+  *free_link (c, object) = s->free;
+  s->free = object;
+  list_remove (&s->elem);
+  if (--s->in_use == 0)
+    list_push_front (&c->empty, &s->elem);
+  else
+    list_push_front (&c->partial, &s->elem);
+  lock_release (&c->lock);
+}
+
+/* Gives every empty slab in every cache back to the page
+   allocator.  Returns the number of pages freed. */
+size_t
+slab_reap (void)
+{
+  struct list reaped;
+  struct list_elem *e;
+  size_t cnt = 0;
+
+  list_init (&reaped);
+  lock_acquire (&all_caches_lock);
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+
+      lock_acquire (&c->lock);
+      while (!list_empty (&c->empty))
+        list_push_back (&reaped, list_pop_front (&c->empty));
+      lock_release (&c->lock);
+    }
+  lock_release (&all_caches_lock);
+
+  while (!list_empty (&reaped))
+    {
+      struct slab *s = list_entry (list_pop_front (&reaped),
+                                   struct slab, elem);
+      ASSERT (s->magic == SLAB_MAGIC && s->in_use == 0);
+      s->magic = 0;
+      palloc_free_page (s);
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Obtains a page for a new slab in cache C, and carves it into
+   free objects, constructing each one if C has a constructor.
+   If no page is free, reaps empty slabs and tries once more.
+   Returns the new slab, or a null pointer if memory is not
+   available. */
+static struct slab *
+new_slab (struct slab_cache *c)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL && slab_reap () > 0)
+    s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+
+  /* Link the objects so that the lowest one is handed out
+     first. */
+  for (i = c->objects_per_slab; i-- > 0; )
+    {
+      void *object = (uint8_t *) s + SLAB_HEADER_SIZE + i * c->slot_size;
+      if (c->ctor != NULL)
+        c->ctor (object);
+      *free_link (c, object) = s->free;
+      s->free = object;
+    }
+  return s;
+}
+
+/* Returns the slab that OBJECT, from cache C, is inside. */
+static struct slab *
+object_to_slab (struct slab_cache *c, void *object)
+{
+  struct slab *s = pg_round_down (object);
+
+  /* Check that the slab is valid and the object is properly
+     aligned within it. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (pg_ofs (object) >= SLAB_HEADER_SIZE);
+  ASSERT ((pg_ofs (object) - SLAB_HEADER_SIZE) % c->slot_size == 0);
+
+  return s;
+}
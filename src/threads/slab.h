@@ -0,0 +1,36 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Puts a freshly carved OBJECT into its initial state. */
+typedef void slab_ctor_func (void *object);
+
+/* A cache of objects of one size, carved out of page-sized
+   slabs.  Each slab is on exactly one of the three lists,
+   according to how many of its objects are in use. */
+struct slab_cache
+  {
+    struct list_elem elem;      /* Element in list of all caches. */
+    const char *name;           /* Name, for debugging. */
+    size_t object_size;         /* Size of each object in bytes. */
+    size_t slot_size;           /* Bytes taken by each object in a slab. */
+    size_t link_ofs;            /* Offset of free link within a slot. */
+    size_t objects_per_slab;    /* Number of objects in a slab. */
+    slab_ctor_func *ctor;       /* Constructor, or null. */
+    struct lock lock;           /* Guards the lists. */
+    struct list partial;        /* Slabs with some objects in use. */
+    struct list full;           /* Slabs with every object in use. */
+    struct list empty;          /* Slabs with no objects in use. */
+  };
+
+void slab_init (void);
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      slab_ctor_func *);
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (struct slab_cache *, void *);
+size_t slab_reap (void);
+
+#endif /* threads/slab.h */
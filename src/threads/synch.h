@@ -41,6 +41,27 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of threads may hold it for
+   reading at once, or a single thread may hold it for writing.
+   Waiting writers take precedence over new readers, so that a
+   steady stream of readers cannot starve a writer. */
+struct rwlock
+  {
+    struct lock lock;             /* Protects the members below. */
+    struct condition readers_ok;  /* Signaled when readers may enter. */
+    struct condition writer_ok;   /* Signaled when a writer may enter. */
+    int readers;                  /* # of threads holding read access. */
+    int waiting_writers;          /* # of threads waiting to write. */
+    struct thread *writer;        /* Thread holding write access, if any. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
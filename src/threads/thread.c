@@ -7,10 +7,12 @@
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,9 +22,15 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO
+   queue per priority level, and bit P of ready_mask is set
+   exactly when ready_queues[P] is nonempty, so that adding a
+   thread and finding the highest-priority ready thread both
+   take constant time. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* # of threads in the ready queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -51,6 +59,7 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long skipped_ticks; /* # of idle ticks with no timer interrupt. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -61,6 +70,21 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.
+
+   recent_cpu decays once per second for every thread, but only
+   the running thread and the ready threads have their decay
+   applied eagerly, since their priorities decide what runs next.
+   A blocked thread instead remembers how many decay steps it
+   has seen (its recent_cpu_epoch) and catches up in
+   thread_unblock(), using the coefficients kept in
+   decay_history, so that the once-a-second work in the timer
+   interrupt does not grow with the number of sleeping threads. */
+#define DECAY_HISTORY 64        /* # of decay coefficients kept. */
+static fixed_t load_avg;        /* System load average. */
+static unsigned mlfqs_epoch;    /* # of decay steps so far. */
+static fixed_t decay_history[DECAY_HISTORY];
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -72,6 +96,14 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_highest (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_second (void);
+static void mlfqs_catch_up (struct thread *);
+static void mlfqs_decay (struct thread *, fixed_t coef, unsigned steps);
+static void mlfqs_update_priority (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -86,10 +118,14 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  ready_mask = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -133,6 +169,9 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -144,6 +183,20 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (timer_tickless)
+    printf ("Thread: %lld idle ticks skipped by tickless idle\n",
+            skipped_ticks);
+}
+
+/* Accounts for CNT timer ticks that passed in the idle thread
+   without a timer interrupt, because the timer was stretched
+   while idle.  Called by the timer in an external interrupt
+   context or with interrupts off. */
+void
+thread_skip_ticks (int64_t cnt)
+{
+  idle_ticks += cnt;
+  skipped_ticks += cnt;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -241,8 +294,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  // list_push_back (&ready_list, &t->elem);
-  list_insert_ordered(&ready_list, &t->elem, priority_order, NULL);
+  if (thread_mlfqs)
+    {
+      mlfqs_catch_up (t);
+      mlfqs_update_priority (t);
+    }
+  ready_queue_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -295,6 +352,9 @@ thread_exit (void)
   process_exit ();
 #endif
 
+  /* Give back the blocks cached for malloc(). */
+  malloc_thread_exit ();
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
@@ -317,7 +377,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_insert_ordered(&ready_list, &cur->elem, priority_order, NULL); 
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -344,6 +404,10 @@ thread_foreach (thread_action_func *func, void *aux)
 void
 thread_set_priority (int new_priority) 
 {
+  /* The MLFQS computes priorities itself */
+  if (thread_mlfqs)
+    return;
+
   enum intr_level old_level = intr_disable();
 
   thread_current ()->priority = new_priority;
@@ -395,49 +459,198 @@ thread_get_priority (void)
 void priority_check(void) {
   enum intr_level old_level = intr_disable ();
 
-  if(!list_empty(&ready_list)) {
-      /* The first element of the ready list, which is the highest priority in the list */
-      struct thread *t = list_entry(list_front(&ready_list), struct thread, elem); 
-
-      /* If the current thread's priority is smaller than the first element
-         in the ready list's priority, then yield */
-      if (thread_current ()->priority < t->priority) {
-        thread_yield ();
-      }
+  /* If the current thread's priority is smaller than the highest
+     priority in the ready queue, then yield */
+  if (thread_current ()->priority < ready_queue_highest ()) {
+    thread_yield ();
   }
 
   intr_set_level(old_level);
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recalculates
+   its priority, yielding if it is no longer the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  mlfqs_update_priority (cur);
+  priority_check ();
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu;
+}
+
+/* Per-tick MLFQS bookkeeping for the running thread CUR, called
+   from thread_tick() in the timer interrupt. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    mlfqs_update_second ();
+  else if (ticks % 4 == 0 && cur != idle_thread)
+    {
+      /* Between once-a-second updates only the running thread's
+         recent_cpu changes, so it is the only priority that can
+         have moved. */
+      mlfqs_update_priority (cur);
+    }
+
+  if (cur->priority < ready_queue_highest ())
+    intr_yield_on_return ();
+}
+
+/* Updates load_avg, records this second's decay coefficient and
+   applies it to the running thread and every ready thread,
+   moving the ready threads to the queues for their new
+   priorities. */
+static void
+mlfqs_update_second (void)
+{
+  struct thread *cur = running_thread ();
+  struct list requeue;
+  fixed_t twice_load;
+  int ready_threads, pri;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* load_avg = (59/60)*load_avg + (1/60)*ready_threads. */
+  ready_threads = ready_cnt + (cur != idle_thread ? 1 : 0);
+  load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                     fp_div_int (fp_from_int (ready_threads), 60));
+
+  /* Decay coefficient (2*load_avg)/(2*load_avg + 1). */
+  twice_load = fp_mul_int (load_avg, 2);
+  decay_history[mlfqs_epoch % DECAY_HISTORY]
+    = fp_div (twice_load, fp_add_int (twice_load, 1));
+  mlfqs_epoch++;
+
+  if (cur != idle_thread)
+    {
+      mlfqs_catch_up (cur);
+      mlfqs_update_priority (cur);
+    }
+
+  /* Pull every ready thread out, highest priority first so that
+     FIFO order is kept among threads that end up sharing a
+     queue, then put each back under its new priority. */
+  list_init (&requeue);
+  for (pri = PRI_MAX; pri >= PRI_MIN; pri--)
+    if (!list_empty (&ready_queues[pri]))
+      list_splice (list_end (&requeue), list_begin (&ready_queues[pri]),
+                   list_end (&ready_queues[pri]));
+  ready_mask = 0;
+  ready_cnt = 0;
+  while (!list_empty (&requeue))
+    {
+      struct thread *t = list_entry (list_pop_front (&requeue),
+                                     struct thread, elem);
+      mlfqs_catch_up (t);
+      mlfqs_update_priority (t);
+      ready_queue_push (t);
+    }
+}
+
+/* Applies to T's recent_cpu every decay step it has missed.
+   Steps still in decay_history use their own coefficients.  Any
+   older ones use the oldest coefficient still kept, which is a
+   close approximation because load_avg moves slowly. */
+static void
+mlfqs_catch_up (struct thread *t)
+{
+  unsigned behind = mlfqs_epoch - t->recent_cpu_epoch;
+
+  if (behind > DECAY_HISTORY)
+    {
+      mlfqs_decay (t, decay_history[mlfqs_epoch % DECAY_HISTORY],
+                   behind - DECAY_HISTORY);
+      t->recent_cpu_epoch = mlfqs_epoch - DECAY_HISTORY;
+    }
+  while (t->recent_cpu_epoch != mlfqs_epoch)
+    {
+      mlfqs_decay (t, decay_history[t->recent_cpu_epoch % DECAY_HISTORY], 1);
+      t->recent_cpu_epoch++;
+    }
+}
+
+/* Applies STEPS decay steps with coefficient COEF to T's
+   recent_cpu in O(log STEPS) time, using the closed form of
+   recent_cpu = COEF * recent_cpu + nice repeated STEPS times:
+
+     COEF^STEPS * recent_cpu + nice * (1 - COEF^STEPS) / (1 - COEF). */
+static void
+mlfqs_decay (struct thread *t, fixed_t coef, unsigned steps)
+{
+  fixed_t power = FP_ONE;
+  fixed_t base = coef;
+
+  if (steps == 1)
+    {
+      t->recent_cpu = fp_add_int (fp_mul (coef, t->recent_cpu), t->nice);
+      return;
+    }
+
+  for (; steps > 0; steps >>= 1)
+    {
+      if (steps & 1)
+        power = fp_mul (power, base);
+      base = fp_mul (base, base);
+    }
+  t->recent_cpu = fp_add (fp_mul (power, t->recent_cpu),
+                          fp_div (fp_mul_int (FP_ONE - power, t->nice),
+                                  FP_ONE - coef));
+}
+
+/* Sets T's priority to PRI_MAX - (recent_cpu / 4) - (nice * 2),
+   clamped to the valid range.  T must not be in a ready queue. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = fp_to_int (fp_sub_int (fp_sub (fp_from_int (PRI_MAX),
+                                                fp_div_int (t->recent_cpu, 4)),
+                                        t->nice * 2));
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  t->priority = priority;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -459,8 +672,14 @@ idle (void *idle_started_ UNUSED)
     {
       /* Let someone else run. */
       intr_disable ();
+      timer_idle_exit ();
       thread_block ();
 
+      /* Nothing else can run, so in tickless mode there is no
+         need for the timer to interrupt until the next sleeper
+         is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
          The `sti' instruction disables interrupts until the
          completion of the next instruction, so these two
@@ -529,18 +748,33 @@ init_thread (struct thread *t, const char *name, int priority)
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
 
+  /* Under the MLFQS a new thread inherits its creator's nice and
+     recent_cpu, and its priority is computed from them */
+  if (thread_mlfqs) {
+    struct thread *parent = running_thread ();
+    if (parent != t) {
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+    }
+    t->recent_cpu_epoch = mlfqs_epoch;
+    mlfqs_update_priority (t);
+    priority = t->priority;
+  }
+
   /* Initialize priority donation */
   t->init_priority = priority;
   t->waiting_lock = NULL;
   list_init(&t->donated_list);
 
-  /* Intialize the list of file descriptors */
-  list_init(&t->fd_list);
-  /* Initialize file descriptor, which should be 2 since 0 is 
-    reserved for STDIN and 1 is for STDOUT */
-  t->fd = 2;
-  
   #ifdef USERPROG
+  /* The file descriptor table is allocated on the first open.  The
+    first file descriptor is 2 since 0 is reserved for STDIN and 1 is
+    for STDOUT */
+  t->fd_table = NULL;
+  t->fd_cap = 0;
+  t->fd_next = 2;
+  t->exec_file = NULL;
+
   /* Initialize the list of children */
   list_init(&t->children_list);
   /* Initialize the alive semaphore */
@@ -550,11 +784,12 @@ init_thread (struct thread *t, const char *name, int priority)
   
   t->exit_status = -1;
   t->loaded = false;
+  #endif
 
+  #ifdef VM
+  /* The supplemental page table is created when the process loads */
+  t->pages = NULL;
   #endif
-  /* Initialize the timer semaphore */
-  sema_init(&t->timer_sema, 0);
-  
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -578,10 +813,62 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int pri = ready_queue_highest ();
+  struct thread *t;
+
+  if (pri < 0)
     return idle_thread;
+
+  t = list_entry (list_pop_front (&ready_queues[pri]), struct thread, elem);
+  if (list_empty (&ready_queues[pri]))
+    ready_mask &= ~((uint64_t) 1 << pri);
+  ready_cnt--;
+  return t;
+}
+
+/* Appends T to the ready queue for its current priority.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from the ready queue.  T must still
+   have the priority it was queued with.  Interrupts must be
+   off. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Returns the highest priority that has a ready thread, or -1 if
+   the ready queue is empty.  Splits ready_mask into 32-bit halves
+   so that no 64-bit helper from libgcc is needed. */
+static int
+ready_queue_highest (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -663,17 +950,6 @@ allocate_tid (void)
   return tid;
 }
 
-/* Returns true if thread_a has a shorter SLEEP time, returns false if thread
- * b has a shorter sleep time. If used in a list orderering function, this
- * will sort the list from smallest to greatest sleep time */
-bool 
-sleep_order(const struct list_elem* a, const struct list_elem* b, void *aux UNUSED) {
-  const struct thread* thread_a = list_entry(a, struct thread, sleep_elem);
-  const struct thread* thread_b = list_entry(b, struct thread, sleep_elem);
-  return thread_a->sleep_ticks < thread_b->sleep_ticks;
-}
-
-
 /* Returns true if thread_a has a LONGER sleep time, returns false if thread
  * b has a longer sleep time. If used in a list orderering function, this
  * will sort the list from GREATEST to SMALLEST priority */
@@ -698,7 +974,15 @@ donation() {
   int depth = 0;
   while(l && depth < MAX_DEPTH) { 
     if(l->holder != NULL && l->holder->priority < t->priority) {
-      l->holder->priority = t->priority;
+      /* A ready holder has to move to the queue for its new priority */
+      if(l->holder->status == THREAD_READY) {
+        ready_queue_remove(l->holder);
+        l->holder->priority = t->priority;
+        ready_queue_push(l->holder);
+      }
+      else {
+        l->holder->priority = t->priority;
+      }
       t = l->holder;
       l = t->waiting_lock;
       depth++;
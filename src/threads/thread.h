@@ -5,6 +5,8 @@
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
+#include "threads/fixed-point.h"
+#include "threads/malloc.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,6 +27,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -95,29 +102,27 @@ struct thread
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
-    /* The list element for the the sleeping list */
-    struct list_elem sleep_elem;
-
     /* The list element for the list of donated threads */
     struct list_elem donation_elem;
 
-    /* The thread's semaphore, owned by threads/synch.h */
-    struct semaphore timer_sema;
-
     /* List of threads that have donated to this thread */
     struct list donated_list;
 
-    /* The current ticks */
+    /* The tick to wake up on, and the order the thread went to
+       sleep in, owned by devices/timer.c */
     int64_t sleep_ticks;
+    unsigned sleep_seq;
 
     /* The lock currently trying to be acquired by the thread */
     struct lock* waiting_lock;
 
-    /* The list of file descriptors that belong to this thread */
-    struct list fd_list;
+    /* Multi-level feedback queue scheduler state, owned by thread.c */
+    int nice;                           /* Nice value. */
+    fixed_t recent_cpu;                 /* Recent CPU time received. */
+    unsigned recent_cpu_epoch;          /* Decay steps applied to recent_cpu. */
 
-    /* A file descriptor that uniquely represents the file opened by this thread */
-    int fd;
+    /* Free blocks cached for malloc(), owned by threads/malloc.c */
+    struct malloc_magazine magazines[MALLOC_CLASS_CNT];
 
     /* Used to wait if a thread is not loaded yet */
     struct semaphore load_sema;
@@ -136,6 +141,22 @@ struct thread
     int exit_status;
     /* Indicates if the child is not dead */
     struct semaphore alive_sema;
+    /* The open files, indexed by file descriptor, owned by userprog/syscall.c */
+    struct file **fd_table;
+    /* The number of slots in fd_table */
+    int fd_cap;
+    /* The lowest file descriptor that might be free */
+    int fd_next;
+    /* The running executable, kept open while the process runs */
+    struct file *exec_file;
+#endif
+#ifdef VM
+    /* Supplemental page table, owned by vm/page.c */
+    struct hash *pages;
+#endif
+#ifdef FILESYS
+    /* Depth of nested file system operations, owned by filesys/journal.c */
+    int journal_depth;
 #endif
 
     /* Owned by thread.c. */
@@ -151,6 +172,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_skip_ticks (int64_t cnt);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -182,7 +204,6 @@ int thread_get_load_avg (void);
 
 void donation(void);
 
-bool sleep_order(const struct list_elem* a, const struct list_elem* b, void *aux UNUSED);
 bool priority_order(const struct list_elem* a, const struct list_elem* b, void *aux UNUSED);
 bool donation_order(const struct list_elem* a, const struct list_elem* b, void *aux UNUSED);
 #endif /* threads/thread.h */
\ No newline at end of file
@@ -4,7 +4,11 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include <user/syscall.h>
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -150,9 +154,20 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page if it is part of the process's address
+     space but has not been loaded yet, or give the process its
+     own copy of a writable page that it shares after a fork.
+     This also covers the kernel touching user memory on behalf
+     of a system call. */
+  if (is_user_vaddr (fault_addr)
+      && (not_present ? page_load (fault_addr)
+          : write && page_unshare (fault_addr)))
+    return;
+#endif
+
+  /* Any other fault is an error in the user process (or, in
+     kernel context, a kernel bug). */
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
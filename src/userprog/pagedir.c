@@ -47,6 +47,42 @@ pagedir_destroy (uint32_t *pd)
   palloc_free_page (pd);
 }
 
+/* Maps a copy of every user page mapped in page directory SRC
+   at the same address in DST, with the same permissions.
+   Returns false if memory allocation fails, leaving the pages
+   copied so far mapped in DST for pagedir_destroy() to free. */
+bool
+pagedir_copy (uint32_t *dst, uint32_t *src) 
+{
+  uint32_t *pde;
+
+  for (pde = src; pde < src + pd_no (PHYS_BASE); pde++)
+    if (*pde & PTE_P) 
+      {
+        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pte;
+
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+          if (*pte & PTE_P) 
+            {
+              void *upage = (void *) (((uintptr_t) (pde - src) << PDSHIFT)
+                                      | ((uintptr_t) (pte - pt) << PTSHIFT));
+              void *kpage = palloc_get_page (PAL_USER);
+
+              if (kpage == NULL)
+                return false;
+              memcpy (kpage, pte_get_page (*pte), PGSIZE);
+              if (!pagedir_set_page (dst, upage, kpage,
+                                     (*pte & PTE_W) != 0)) 
+                {
+                  palloc_free_page (kpage);
+                  return false;
+                }
+            }
+      }
+  return true;
+}
+
 /* Returns the address of the page table entry for virtual
    address VADDR in page directory PD.
    If PD does not have a page table for VADDR, behavior depends
@@ -156,6 +192,34 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Returns true if the PTE for virtual page VPAGE in PD is
+   present and allows user writes.
+   Returns false if PD contains no PTE for VPAGE. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        {
+          *pte &= ~(uint32_t) PTE_W;
+          invalidate_pagedir (pd);
+        }
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -17,11 +18,23 @@
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static void adopt_child (tid_t tid);
 static void check_tid (struct thread *t, void *aux UNUSED);
 
+/* What a child created by process_fork needs from its parent */
+struct fork_args
+  {
+    struct thread *parent;              /* The forking process. */
+    struct intr_frame if_;              /* Its registers at the fork. */
+  };
+
 
 /* The TID of the new thread we create in process_execute, used in check_tid, inspired by ChristianJHughes */
 static tid_t new_thread_tid;
@@ -62,21 +75,56 @@ process_execute (const char *file_name)
     palloc_free_page (fn_copy); 
   }
   else {
-    new_thread_tid = tid;
-    /* Disable interrupts, as required by thread_foreach  */
-    enum intr_level old_level = intr_disable();
-    /* Find the thread that matches the TID of the new thread we just created,
-       and set it to new_thread */
-    thread_foreach(*check_tid, NULL);
-    /* wait until we are done loading the new thread */
-    sema_down(&new_thread->load_sema);
-    /* Finally, add the new thread we created to the current thread's list of children */
-    list_push_back(&thread_current()->children_list, &new_thread->child_elem);
-    intr_set_level (old_level);
+    adopt_child (tid);
   }
   return tid;
 }
 
+/* Waits until the new thread TID is done loading, successfully or not,
+   and adds it to the current thread's list of children */
+static void
+adopt_child (tid_t tid)
+{
+  /* Disable interrupts, as required by thread_foreach  */
+  enum intr_level old_level = intr_disable();
+  /* Find the thread that matches the TID of the new thread we just created,
+     and set it to new_thread.  Take a local copy before blocking, since
+     other processes may call exec while we wait for the load */
+  new_thread_tid = tid;
+  thread_foreach(*check_tid, NULL);
+  struct thread *child = new_thread;
+  /* wait until we are done loading the new thread */
+  sema_down(&child->load_sema);
+  /* Finally, add the new thread we created to the current thread's list of children */
+  list_push_back(&thread_current()->children_list, &child->child_elem);
+  intr_set_level (old_level);
+}
+
+/* Starts a new process that is a copy of the current one, without
+   loading anything from disk: it shares the current process's pages
+   copy-on-write under VM, or gets a copy of each of them otherwise,
+   and gets its own copy of each open file.  The new process resumes
+   from the same system call, which returns 0 there.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be created */
+tid_t
+process_fork (void)
+{
+  struct fork_args args;
+  tid_t tid;
+
+  /* The registers of the system call we are in were saved in an
+     interrupt frame at the top of our kernel stack, which is where
+     tss_update() tells the CPU to switch stacks to */
+  args.parent = thread_current ();
+  args.if_ = ((struct intr_frame *) ((uint8_t *) args.parent + PGSIZE))[-1];
+
+  /* The child copies ARGS before letting adopt_child() return */
+  tid = thread_create (args.parent->name, PRI_DEFAULT, start_fork, &args);
+  if (tid != TID_ERROR)
+    adopt_child (tid);
+  return tid;
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -112,6 +160,52 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* A thread function that turns a new thread into a copy of the
+   process that forked it and starts it running */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *cur = thread_current ();
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
+  bool success = false;
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+  process_activate ();
+
+  /* Keep our own handle on the executable, as load() does */
+  cur->exec_file = file_reopen (parent->exec_file);
+  if (cur->exec_file == NULL)
+    goto done;
+  file_deny_write (cur->exec_file);
+
+#ifdef VM
+  cur->pages = page_table_create ();
+  if (cur->pages == NULL
+      || !page_table_copy (parent->pages, cur->exec_file))
+    goto done;
+#else
+  if (!pagedir_copy (cur->pagedir, parent->pagedir))
+    goto done;
+#endif
+  success = copy_file_table (parent);
+
+ done:
+  /* Indicate if the fork was successful, and wake the parent */
+  cur->loaded = success;
+  sema_up (&cur->load_sema);
+  if (!success)
+    thread_exit ();
+
+  /* The child sees fork() return 0 */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -160,6 +254,17 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  /* Close the files this process left open */
+  close_all_files ();
+
+#ifdef VM
+  /* Free the supplemental page table, with the frames and swap
+     slots that hold its pages, while the page directory they are
+     mapped in still exists */
+  page_table_destroy (cur->pages);
+  cur->pages = NULL;
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -176,6 +281,10 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Close the executable, which also allows writes to it again */
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -289,6 +398,13 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
+#ifdef VM
+  /* Allocate the supplemental page table for lazy loading */
+  t->pages = page_table_create ();
+  if (t->pages == NULL)
+    goto done;
+#endif
+
 
   /* List of all string arguments to be passed to the stack */
   char *argv[MAX_ARGS_SIZE];
@@ -389,9 +505,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* Deny writes to the open file */
+  /* Deny writes to the open file, and keep it open until the process
+     exits, since its pages may still be loaded from it */
   if(success) {
     file_deny_write(file);
+    t->exec_file = file;
   }
   /* If we could not load the file successfully, close it */
   else {
@@ -402,7 +520,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -461,6 +581,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only entered in the supplemental page
+   table here, and each is read or zeroed when first accessed.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -471,7 +594,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
   file_seek (file, ofs);
+#endif
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -480,6 +605,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where the page comes from, and leave the reading
+         to the page fault handler on first touch.  Pages with
+         nothing to read, such as BSS, are zeroed then too. */
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
+
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -499,6 +633,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -516,10 +651,23 @@ setup_stack (void **esp, int argc, char *argv[])
   uint8_t *kpage;
   bool success = false;
 
+#ifdef VM
+  /* The stack page is a zero page like BSS, so that it can be
+     evicted like any other, but it is brought in right away */
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  kpage = NULL;
+  if (page_add_file (upage, NULL, 0, 0, true) && page_load (upage))
+    kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+#else
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#endif
   if (kpage != NULL) 
     {
+#ifdef VM
+      success = true;
+#else
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+#endif
       if (success)
       {
       	/* The base stack pointer %esp */
@@ -568,6 +716,7 @@ setup_stack (void **esp, int argc, char *argv[])
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -587,6 +736,7 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
 
 
 /* Adds each of the command line arguments to the list of command line arguments, argv.
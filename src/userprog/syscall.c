@@ -1,148 +1,248 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/init.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "devices/timer.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 
 static void syscall_handler (struct intr_frame *);
 void check_valid_ptr (const void *ptr);
-void check_valid_buffer(void *buffer, unsigned size);
-void get_arguments(struct intr_frame *f, int *args, int n);
+static void *pin_user_page(const void *uaddr, bool writable);
+static void *try_pin_user_page(const void *uaddr, bool writable);
+static void unpin_user_page(const void *uaddr);
+static unsigned page_chunk(const void *uaddr, unsigned size);
+static char *copy_in_string(const char *ustr);
+static void check_valid_range(const void *uaddr, size_t size);
 int get_kernel_ptr(const void *user_ptr);
-struct file* get_file_from_list(int fd);
-void remove_file_from_list(int fd);
-void create_file_entry(struct file* open_file, int fd);
+struct file* get_file_from_table(int fd);
+void remove_file_from_table(int fd);
+int add_file_to_table(struct file* open_file);
 
 /* The bottom of the user virtual address space */
 #define MIN_VIRTUAL_ADDR ((void *) 0x08048000)
 
-/* A lock to ensure multiple processes can't edit a file at the same time */
-struct lock file_lock;
+/* The first file descriptor handed out by open, since 0 is
+   reserved for STDIN and 1 is for STDOUT */
+#define FD_MIN 2
+
+/* The initial number of slots in a process's file descriptor table */
+#define FD_TABLE_INIT 16
+
+/* A system call, given its arguments off the user stack, returning the
+   value for the EAX register */
+typedef int syscall_func(const int *args);
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait, sys_create,
+  sys_remove, sys_open, sys_filesize, sys_read, sys_write, sys_seek,
+  sys_tell, sys_close, sys_fork, sys_uptime;
+
+/* Handlers for the system calls we implement, by system call number.
+   The rest are NULL and kill the process */
+static syscall_func *const syscall_table[SYS_CNT] = {
+  [SYS_HALT] = sys_halt,
+  [SYS_EXIT] = sys_exit,
+  [SYS_EXEC] = sys_exec,
+  [SYS_WAIT] = sys_wait,
+  [SYS_CREATE] = sys_create,
+  [SYS_REMOVE] = sys_remove,
+  [SYS_OPEN] = sys_open,
+  [SYS_FILESIZE] = sys_filesize,
+  [SYS_READ] = sys_read,
+  [SYS_WRITE] = sys_write,
+  [SYS_SEEK] = sys_seek,
+  [SYS_TELL] = sys_tell,
+  [SYS_CLOSE] = sys_close,
+  [SYS_FORK] = sys_fork,
+  [SYS_UPTIME] = sys_uptime,
+};
 
-/* Contains mapping of files to their file descriptors 
-   to be added to list of file descriptors */
-struct file_entry {
-  struct file *file;
-  int fd;
-  struct list_elem file_elem;
+/* Number of arguments each system call takes */
+static const int syscall_arg_cnt[SYS_CNT] = SYS_ARG_CNTS;
+
+/* System call names, for syscall_print_stats */
+static const char *const syscall_names[SYS_CNT] = {
+  [SYS_HALT] = "halt",
+  [SYS_EXIT] = "exit",
+  [SYS_EXEC] = "exec",
+  [SYS_WAIT] = "wait",
+  [SYS_CREATE] = "create",
+  [SYS_REMOVE] = "remove",
+  [SYS_OPEN] = "open",
+  [SYS_FILESIZE] = "filesize",
+  [SYS_READ] = "read",
+  [SYS_WRITE] = "write",
+  [SYS_SEEK] = "seek",
+  [SYS_TELL] = "tell",
+  [SYS_CLOSE] = "close",
+  [SYS_MMAP] = "mmap",
+  [SYS_MUNMAP] = "munmap",
+  [SYS_CHDIR] = "chdir",
+  [SYS_MKDIR] = "mkdir",
+  [SYS_READDIR] = "readdir",
+  [SYS_ISDIR] = "isdir",
+  [SYS_INUMBER] = "inumber",
+  [SYS_FORK] = "fork",
+  [SYS_UPTIME] = "uptime",
 };
 
+/* Calls made to each system call, and timer ticks spent in them */
+static int64_t syscall_calls[SYS_CNT];
+static int64_t syscall_ticks[SYS_CNT];
+
 void
 syscall_init (void) 
 {
-  lock_init(&file_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
 {  
-  /* The stack arguments -> we will only ever need up to 3 */
-  int args[3];
-  /* Ensure user provided pointer is valid/safe */
-  check_valid_ptr((const void *) f->esp);
-  
-  /* Based on what the system call number the
-   stack pointer is point to, make an appropriate system call */
-  switch(*(int *) f->esp) {
-  	/* Halt the operating system. */
-  	case SYS_HALT:
-      halt();
-  		break;
-  	/* Terminate this process. */
-  	case SYS_EXIT:
-  		get_arguments(f, &args[0], 1);
-  		exit(args[0]);
-  		break;
-  	/* Start another process. */
-  	case SYS_EXEC:
-      get_arguments(f, &args[0], 1);
-      /* Transforms argument from user virtual address to kernel virtual address */
-      args[0] = get_kernel_ptr((const void*) args[0]);
-      f->eax = exec((const char*) args[0]);
-  		break;
-  	/* Wait for a child process to die. */
-  	case SYS_WAIT:
-      get_arguments(f, &args[0], 1);
-      f->eax = wait((pid_t) args[0]);
-  		break;
-  	/* Create a file. */
-  	case SYS_CREATE:
-      get_arguments(f, &args[0], 2);
-      /* Transforms file from user virtual address to kernel virtual address */
-      args[0] = get_kernel_ptr((const void*) args[0]);
-      f->eax = create((const char*) args[0], (unsigned) args[1]);
-  		break;
-  	/* Delete a file. */
-  	case SYS_REMOVE:
-      get_arguments(f, &args[0], 1);
-      /* Transforms file from user virtual address to kernel virtual address */
-      args[0] = get_kernel_ptr((const void*) args[0]);
-      f->eax = remove((const char*) args[0]);
-  		break;
-  	/* Open a file. */
-  	case SYS_OPEN:
-      get_arguments(f, &args[0], 1);
-      args[0] = get_kernel_ptr((const void*) args[0]);
-      f->eax = open((const char*) args[0]);
-  		break;
-  	/* Obtain a file's size. */
-  	case SYS_FILESIZE:
-      get_arguments(f, &args[0], 1);
-      f->eax = filesize(args[0]);;
-  		break;
-  	/* Read from a file. */
-  	case SYS_READ:
-      /* Get the 3 arguments for read (filename, buffer, and size) off the stack */ 
-      get_arguments(f, &args[0], 3);
-      /* Ensure the buffer is valid */
-      check_valid_buffer((void*) args[1], (unsigned) args[2]);
-      /* Transform buffer from user virtual address to kernel virtual address */
-      args[1] = get_kernel_ptr((const void*) args[1]);   
-      f->eax = read(args[0], (void *) args[1], (unsigned) args[2]);
-  		break;
-  	/* Write to a file. */
-  	case SYS_WRITE:
-  		/* Get the 3 arguments for write (filename, buffer, and size) off the stack */ 
-  		get_arguments(f, &args[0], 3);
-  		/* Ensure the buffer is valid */
-  		check_valid_buffer((void*) args[1], (unsigned) args[2]);
-  		/* Transform buffer from user virtual address to kernel virtual address */
-  		args[1] = get_kernel_ptr((const void*) args[1]);		
-  		f->eax = write(args[0], (const void *) args[1], (unsigned) args[2]);
-  		break;
-  	/* Change position in a file. */
-  	case SYS_SEEK:
-      get_arguments(f, &args[0], 2);
-      /* Returns result of seek in EAX register */
-      seek(args[0], (unsigned) args[1]);
-  		break;
-  	/* Report current position in a file. */
-  	case SYS_TELL:
-      get_arguments(f, &args[0], 1);
-      f->eax = tell(args[0]);
-  		break;
-  	/* Close a file. */
-  	case SYS_CLOSE:
-      get_arguments(f, &args[0], 1);
-      close(args[0]);
-  		break;
-  	default:
-  		exit(-1);
-  		break;
-
-  }
- 
+  const int *sp = f->esp;
+  int number;
+  int64_t start, elapsed;
+  enum intr_level old_level;
+
+  /* Ensure the system call number, and then all of its arguments,
+     lie in valid user memory, with one check each */
+  check_valid_range(sp, sizeof *sp);
+  number = *sp;
+  if(number < 0 || number >= SYS_CNT || syscall_table[number] == NULL) {
+    exit(-1);
+  }
+  check_valid_range(sp, (syscall_arg_cnt[number] + 1) * sizeof *sp);
+
+  /* exit and halt do not return, so count the call before making it.
+     The counters are shared by every process and are 64 bits wide,
+     so update them with interrupts off */
+  old_level = intr_disable();
+  syscall_calls[number]++;
+  intr_set_level(old_level);
+  start = timer_ticks();
+  f->eax = syscall_table[number](sp + 1);
+  elapsed = timer_elapsed(start);
+  old_level = intr_disable();
+  syscall_ticks[number] += elapsed;
+  intr_set_level(old_level);
+}
+
+/* Prints how often each system call was made and the timer ticks
+   spent in it */
+void
+syscall_print_stats (void) 
+{
+  int i;
+
+  for(i = 0; i < SYS_CNT; i++) {
+    if(syscall_calls[i] > 0) {
+      printf ("Syscall: %s: %lld calls, %lld ticks\n",
+              syscall_names[i], syscall_calls[i], syscall_ticks[i]);
+    }
+  }
+}
+
+/* The table entries, which unpack the arguments for each system call.
+   String arguments are translated from user virtual addresses to
+   kernel virtual addresses first */
+
+static int sys_halt(const int *args UNUSED) {
+  halt();
+  NOT_REACHED();
+}
+
+static int sys_exit(const int *args) {
+  exit(args[0]);
+  NOT_REACHED();
+}
+
+/* exec, create, remove and open copy their string argument into the
+   kernel first, since the file system may block with it in use, and
+   an unpinned user page could be evicted and reused meanwhile */
+static int sys_exec(const int *args) {
+  char *cmd_line = copy_in_string((const char *) args[0]);
+  pid_t pid = exec(cmd_line);
+
+  palloc_free_page(cmd_line);
+  return pid;
+}
+
+static int sys_wait(const int *args) {
+  return wait((pid_t) args[0]);
+}
+
+static int sys_create(const int *args) {
+  char *file = copy_in_string((const char *) args[0]);
+  bool success = file != NULL && create(file, (unsigned) args[1]);
+
+  palloc_free_page(file);
+  return success;
+}
+
+static int sys_remove(const int *args) {
+  char *file = copy_in_string((const char *) args[0]);
+  bool success = file != NULL && remove(file);
+
+  palloc_free_page(file);
+  return success;
+}
+
+static int sys_open(const int *args) {
+  char *file = copy_in_string((const char *) args[0]);
+  int fd = file != NULL ? open(file) : -1;
+
+  palloc_free_page(file);
+  return fd;
+}
+
+static int sys_filesize(const int *args) {
+  return filesize(args[0]);
+}
+
+/* read() and write() check the buffer themselves, a page at a time */
+static int sys_read(const int *args) {
+  return read(args[0], (void *) args[1], (unsigned) args[2]);
+}
+
+static int sys_write(const int *args) {
+  return write(args[0], (const void *) args[1], (unsigned) args[2]);
+}
+
+static int sys_seek(const int *args) {
+  seek(args[0], (unsigned) args[1]);
+  return 0;
+}
+
+static int sys_tell(const int *args) {
+  return tell(args[0]);
+}
+
+static int sys_close(const int *args) {
+  close(args[0]);
+  return 0;
+}
+
+static int sys_fork(const int *args UNUSED) {
+  return fork();
+}
+
+/* Timer ticks since boot, so that tests can time themselves */
+static int sys_uptime(const int *args UNUSED) {
+  return timer_ticks();
 }
 
 /* Terminates pintos -- rarely used */
@@ -173,14 +273,26 @@ pid_t exec (const char *cmd_line) {
     return -1;
   }
 
-  lock_acquire(&file_lock);
   /* Create a new process */
   pid_t child_tid = process_execute(cmd_line);
   struct thread* child = process_get_child(parent, child_tid);
-  if(!child->loaded) {
+  if(child == NULL || !child->loaded) {
+    child_tid = -1;
+  }
+  return child_tid;
+}
+
+/* Creates a copy of the current process, which shares its memory
+   copy-on-write and has its own copy of each of its open files.
+   Returns the child's PID in the parent and 0 in the child, or -1 if
+   the child could not be created */
+pid_t fork (void) {
+  pid_t child_tid = process_fork();
+  struct thread* child = process_get_child(thread_current(), child_tid);
+
+  if(child == NULL || !child->loaded) {
     child_tid = -1;
   }
-  lock_release(&file_lock);
   return child_tid;
 }
 
@@ -190,128 +302,146 @@ int wait (pid_t pid) {
 
 /* Create a new file, and return true if successful */
 bool create (const char *file, unsigned initial_size) {
-  /* Use a lock to avoid race conditions */
-  lock_acquire(&file_lock);
   bool success = filesys_create(file, initial_size);
-  lock_release(&file_lock);
   return success;
 }
 
 /* Deletes the file called file, returns true if successful */
 bool remove (const char *file) {
-  /* Use a lock to avoid race conditions */
-  lock_acquire(&file_lock);
   bool success = filesys_remove(file);
-  lock_release(&file_lock);
   return success;
 }
 
 /* Opens the file passed in, and return its file descriptor */
 int open (const char *file) {
-  lock_acquire(&file_lock);
   /* Open the closed file */
   struct file* open_file = filesys_open(file);
 
   /* If the file cannot be opened, return an error */
   if(open_file == NULL) {
-    lock_release(&file_lock);
     return -1;
   }
 
-  /* Get the current file descriptor */
-  int fd = thread_current()->fd;
-
-  /* Create and populate a new file_entry */
-  create_file_entry(open_file, fd);
-
-  /* Move to the next file descriptor. E.g. if the current file descriptor
-     is 10, we want to ensure the next file opened has a file descriptor of 11. */
-  thread_current()->fd++;
+  /* Give the file the lowest free file descriptor */
+  int fd = add_file_to_table(open_file);
+  if(fd == -1) {
+    file_close(open_file);
+  }
 
-  lock_release(&file_lock);
   return fd;
 }
 
 /* Returns the size, in bytes, of the file open */
 int filesize (int fd) {
-  lock_acquire(&file_lock);
-  struct file* f = get_file_from_list(fd);
+  struct file* f = get_file_from_table(fd);
 
   /* Ensure the file was found */
   if(f == NULL) {
-    lock_release(&file_lock);
     return -1;
   }
 
   int size = file_length(f);
-  lock_release(&file_lock);
   return size;
 }
 
-/* Reads size bytes from the file open as fd into buffer.
+/* Reads size bytes from the file open as fd into the user buffer.
    Returns the number of bytes actually read (0 at end of file)
    or -1 if the file could not be read */
 int read (int fd, void *buffer, unsigned size) {
-  lock_acquire(&file_lock);
-  /* Check if standard input */
-  if(fd == STDIN_FILENO) {
-    /* Read input from the keyboard */
-    int size = (int) input_getc();
-    lock_release(&file_lock);
-    return size;
-  }
-  /* If we are supposed to be writing instead of reading, or the list is
-     empty, we will not write */
-  else if (fd == STDOUT_FILENO || list_empty(&thread_current()->fd_list)) {
-    lock_release(&file_lock);
+  struct file *f = NULL;
+  uint8_t *udst = buffer;
+  int bytes = 0;
+
+  /* If we are supposed to be writing instead of reading, we will not read */
+  if(fd == STDOUT_FILENO) {
     return 0;
   }
+  /* For all other file descriptors except standard input, we must get
+     the file from the file descriptor table. */
+  if(fd != STDIN_FILENO) {
+    f = get_file_from_table(fd);
+    /* The file could not be read due to a condition other than end of file */
+    if(f == NULL) {
+      return -1;
+    }
+  }
 
-  /* For all other file descriptors, we must get the file from
-     fd_list with the matching file descriptor. */
-  struct file* f = get_file_from_list(fd);
-  /* The file could not be read due to a condition other than end of file */
-  if(f == NULL) {
-    lock_release(&file_lock);
-    return -1;
+  /* Read a page at a time, straight into the memory behind each page
+     of the buffer, since consecutive user pages need not be
+     consecutive in kernel memory */
+  while(size > 0) {
+    unsigned chunk = page_chunk(udst, size);
+    uint8_t *kdst = pin_user_page(udst, true);
+    int n;
+
+    if(f == NULL) {
+      /* Read input from the keyboard */
+      for(n = 0; n < (int) chunk; n++) {
+        kdst[n] = input_getc();
+      }
+    }
+    else {
+      n = file_read(f, kdst, chunk);
+    }
+    unpin_user_page(udst);
+
+    bytes += n;
+    udst += n;
+    size -= n;
+    /* Stop at end of file */
+    if(n < (int) chunk) {
+      break;
+    }
   }
-  /* Since we are reading from a file and not the keyboard, we must 
-     call file_read instead of input_getc */
-  int bytes = file_read(f, buffer, size);
-  lock_release(&file_lock);
   return bytes;
-  
 }
 
-/* Writes to a file. Returns size of file we wrote. */
+/* Writes size bytes from the user buffer to a file.
+   Returns the number of bytes actually written */
 int write (int fd, const void *buffer, unsigned size) {
-  lock_acquire(&file_lock);
-	/* If the file descriptor is standard output,
-	   we write the buffer to the console instead of a not a file */
-	if(fd == STDOUT_FILENO) {
-		/* Prints the entire buffer to the console */
-		putbuf(buffer, size);
-    lock_release(&file_lock);
-		return size;
-	}
-  /* If we are supposed to be reading instead of writing, or the list is
-     empty, we will not write */
-  else if (fd == STDIN_FILENO || list_empty(&thread_current()->fd_list)) {
-    lock_release(&file_lock);
+  struct file *f = NULL;
+  const uint8_t *usrc = buffer;
+  int bytes = 0;
+
+  /* If we are supposed to be reading instead of writing, we will not write */
+  if(fd == STDIN_FILENO) {
     return 0;
   }
-	/* For all other file descriptors, we must get the file from
-     fd_list with the matching file descriptor. */
-  struct file* f = get_file_from_list(fd);
-  /* The file could not be written due to a condition other than end of file */
-  if(f == NULL) {
-    lock_release(&file_lock);
-    return -1;
+	/* For all other file descriptors except standard output, we must get
+     the file from the file descriptor table. */
+  if(fd != STDOUT_FILENO) {
+    f = get_file_from_table(fd);
+    /* The file could not be written due to a condition other than end of file */
+    if(f == NULL) {
+      return -1;
+    }
+  }
+
+  /* Write a page at a time, straight from the memory behind each page
+     of the buffer */
+  while(size > 0) {
+    unsigned chunk = page_chunk(usrc, size);
+    const uint8_t *ksrc = pin_user_page(usrc, false);
+    int n;
+
+    if(f == NULL) {
+      /* Print to the console instead of a file */
+      putbuf((const char *) ksrc, chunk);
+      n = chunk;
+    }
+    else {
+      n = file_write(f, ksrc, chunk);
+    }
+    unpin_user_page(usrc);
+
+    bytes += n;
+    usrc += n;
+    size -= n;
+    /* Stop when the file cannot grow or is not writable */
+    if(n < (int) chunk) {
+      break;
+    }
   }
-  /* Since we are writing to a file and not the keyboard, we must 
-     call file_write instead of putbuf */
-  int bytes = file_write(f, buffer, size);
-  lock_release(&file_lock);
   return bytes;
 }
 
@@ -319,39 +449,31 @@ int write (int fd, const void *buffer, unsigned size) {
 /* Changes the next byte to be read or written in open file fd to position,
    expressed in bytes from the beginning of the file */
 void seek (int fd, unsigned position) {
-  lock_acquire(&file_lock);
   /* Gets a file with a matching file descriptor */
-  struct file *f = get_file_from_list(fd);
+  struct file *f = get_file_from_table(fd);
 
   if(f == NULL) {
-    lock_release(&file_lock);
     return;
   }
   file_seek(f, position);
-  lock_release(&file_lock);
 }
 
 /* Returns the position of the next byte to be read 
    or written in the open file fd */
 unsigned tell (int fd) {
-  lock_acquire(&file_lock);
   /* Gets a file with a matching file descriptor */
-  struct file *f = get_file_from_list(fd);
+  struct file *f = get_file_from_table(fd);
 
   if(f == NULL) {
-    lock_release(&file_lock);
     return -1;
   }
   unsigned pos = (unsigned) file_tell(f);
-  lock_release(&file_lock);
   return pos;
 }
 
 /* Closes the passed file descriptor */
 void close (int fd) {
-  lock_acquire(&file_lock);
-  remove_file_from_list(fd);
-  lock_release(&file_lock);
+  remove_file_from_table(fd);
 }
 
 /* Ensures the pointer is valid */
@@ -364,16 +486,91 @@ void check_valid_ptr(const void *ptr) {
 	}
 }
 
-/* Ensures the buffer is valid */
-void check_valid_buffer(void *buffer, unsigned size) {
-	/* If a pointer is null, is not a user virtual address,
-	 or points to unmapped memory, it is invalid*/
-	char *ptr = (char*) buffer;
-	for(unsigned i = 0; i < size; i++) {
-		check_valid_ptr((const void*) ptr);
-		ptr++;
-	}
-	
+/* Returns the kernel address that the user address uaddr maps to,
+   after checking its page as a whole: it must be mapped, and writable
+   if writable is true, or the process is killed.  Under VM the page is
+   brought in and pinned, so that it cannot be evicted while the file
+   system copies to or from it, and a page shared since a fork is
+   copied before the kernel writes to it.  Undo with unpin_user_page */
+static void *pin_user_page(const void *uaddr, bool writable) {
+  void *kernel_ptr = try_pin_user_page(uaddr, writable);
+
+  if(kernel_ptr == NULL) {
+    exit(-1);
+  }
+  return kernel_ptr;
+}
+
+/* Like pin_user_page, but returns NULL instead of killing the process
+   if uaddr's page is not mapped, or not writable when writable is
+   true */
+static void *try_pin_user_page(const void *uaddr, bool writable) {
+  void *kernel_ptr;
+
+  if(uaddr == NULL || !is_user_vaddr(uaddr) || uaddr < MIN_VIRTUAL_ADDR) {
+    return NULL;
+  }
+#ifdef VM
+  kernel_ptr = page_pin(uaddr, writable);
+#else
+  uint32_t *pd = thread_current()->pagedir;
+
+  kernel_ptr = pagedir_get_page(pd, uaddr);
+  if(kernel_ptr != NULL && writable && !pagedir_is_writable(pd, uaddr)) {
+    kernel_ptr = NULL;
+  }
+#endif
+  return kernel_ptr;
+}
+
+/* Releases a page returned by pin_user_page */
+static void unpin_user_page(const void *uaddr UNUSED) {
+#ifdef VM
+  page_unpin(uaddr);
+#endif
+}
+
+/* Returns how many of the size bytes starting at uaddr lie in the
+   same page as uaddr */
+static unsigned page_chunk(const void *uaddr, unsigned size) {
+  unsigned left = PGSIZE - pg_ofs(uaddr);
+  return size < left ? size : left;
+}
+
+/* Copies the null-terminated string at user address ustr into a new
+   page, a pinned user page at a time, killing the process if any of it
+   is not mapped or it does not fit in a page, without leaking the copy.
+   Returns the copy, which
+   the caller must free with palloc_free_page, or NULL if no page is
+   available */
+static char *copy_in_string(const char *ustr) {
+  char *kstr = palloc_get_page(0);
+  size_t len = 0;
+  bool done = false;
+
+  if(kstr == NULL) {
+    return NULL;
+  }
+  while(!done && len < PGSIZE) {
+    const char *usrc = ustr + len;
+    const char *ksrc = try_pin_user_page(usrc, false);
+    unsigned chunk = page_chunk(usrc, PGSIZE - len);
+    unsigned i;
+
+    if(ksrc == NULL) {
+      break;
+    }
+    for(i = 0; i < chunk && !done; i++) {
+      kstr[len++] = ksrc[i];
+      done = ksrc[i] == '\0';
+    }
+    unpin_user_page(usrc);
+  }
+  if(!done) {
+    palloc_free_page(kstr);
+    exit(-1);
+  }
+  return kstr;
 }
 
 /* Converts the user pointer to a kernel pointer and returns it */
@@ -382,6 +579,12 @@ int get_kernel_ptr(const void *user_ptr) {
   check_valid_ptr(user_ptr);
   /* Converts the user pointer to a kernel pointer */
   void *kernel_ptr = pagedir_get_page(thread_current()->pagedir, user_ptr);
+#ifdef VM
+  /* The page may not have been loaded yet, so fault it in and try again */
+  if(kernel_ptr == NULL && page_load(user_ptr)) {
+    kernel_ptr = pagedir_get_page(thread_current()->pagedir, user_ptr);
+  }
+#endif
   /* Ensure the kernel pointer is not null */
   if(kernel_ptr == NULL) {
     exit(-1);
@@ -389,60 +592,128 @@ int get_kernel_ptr(const void *user_ptr) {
   return (int) kernel_ptr;
 }
 
-/* Gets n arguments off of the stack */
-void get_arguments(struct intr_frame *f, int *args, int n) {
-	int *arg;
-	for(int i = 0; i < n; i++) {
-		arg = (int*) f->esp + i + 1;
-		check_valid_ptr((const void*) arg);
-		args[i] = *arg;
-	}
+/* Ensures that all size bytes starting at uaddr are mapped user memory.
+   size must be small enough that they span at most two pages, so it is
+   enough to check the first and last bytes */
+static void check_valid_range(const void *uaddr, size_t size) {
+  const char *last = (const char *) uaddr + size - 1;
+
+  ASSERT(size > 0 && size <= PGSIZE);
+  if(last < (const char *) uaddr) {
+    exit(-1);
+  }
+  get_kernel_ptr(uaddr);
+  get_kernel_ptr(last);
 }
 
-/* Gets a file from the list of file_entrys based off the file descriptor */
-struct file* get_file_from_list(int fd) {
-  struct list_elem *e;
+/* Gets a file from the current thread's file descriptor table, or NULL
+   if FD is not open */
+struct file* get_file_from_table(int fd) {
+  struct thread *t = thread_current();
 
-  for(e  = list_front(&thread_current()->fd_list); e != NULL; e = e->next) {
-    struct file_entry *file_entry = list_entry(e, struct file_entry, file_elem);
-    if(fd == file_entry->fd) {
-      return file_entry->file;
-    }
+  if(fd < FD_MIN || fd >= t->fd_cap) {
+    return NULL;
   }
-  return NULL;
+  return t->fd_table[fd];
 }
 
-/* Removes and closes a file from the list of file_entrys based off the file descriptor */
-void remove_file_from_list(int fd) {
-  /* Ensure the list is not empty */
-  if(list_empty(&thread_current()->fd_list)) {
+/* Removes and closes a file from the file descriptor table, making its
+   file descriptor available for reuse */
+void remove_file_from_table(int fd) {
+  struct thread *t = thread_current();
+  struct file *f = get_file_from_table(fd);
+
+  if(f == NULL) {
     return;
   }
+  file_close(f);
+  t->fd_table[fd] = NULL;
+
+  /* Keep fd_next pointing at or below the lowest free slot */
+  if(fd < t->fd_next) {
+    t->fd_next = fd;
+  }
+}
 
-  struct list_elem *e;
+/* Puts open_file in the lowest free slot of the file descriptor table,
+   doubling the table when it is full, and returns the file descriptor,
+   or -1 if the table cannot grow */
+int add_file_to_table(struct file* open_file) {
+  struct thread *t = thread_current();
+  int fd;
+
+  /* Every slot below fd_next is in use, so start looking there */
+  for(fd = t->fd_next; fd < t->fd_cap; fd++) {
+    if(t->fd_table[fd] == NULL) {
+      break;
+    }
+  }
 
-  for(e  = list_front(&thread_current()->fd_list); e != NULL; e = e->next) {
-    struct file_entry *file_entry = list_entry(e, struct file_entry, file_elem);
-    if(fd == file_entry->fd) {
-      file_close(file_entry->file);
-      list_remove(&file_entry->file_elem);
-      return; // We are only removing one file_entry, so we're done
+  if(fd == t->fd_cap) {
+    int new_cap = t->fd_cap > 0 ? t->fd_cap * 2 : FD_TABLE_INIT;
+    struct file **new_table = realloc(t->fd_table, new_cap * sizeof *new_table);
+    if(new_table == NULL) {
+      return -1;
     }
+    memset(new_table + t->fd_cap, 0, (new_cap - t->fd_cap) * sizeof *new_table);
+    t->fd_table = new_table;
+    t->fd_cap = new_cap;
   }
+
+  t->fd_table[fd] = open_file;
+  t->fd_next = fd + 1;
+  return fd;
+}
+
+/* Gives the current thread its own copy of every file parent has
+   open, under the same file descriptor and at the same position.
+   Called when a process forks.  Returns false if memory runs out,
+   leaving the files copied so far for close_all_files */
+bool copy_file_table(struct thread *parent) {
+  struct thread *t = thread_current();
+  int fd;
+
+  if(parent->fd_table == NULL) {
+    return true;
+  }
+  t->fd_table = calloc(parent->fd_cap, sizeof *t->fd_table);
+  if(t->fd_table == NULL) {
+    return false;
+  }
+  t->fd_cap = parent->fd_cap;
+  t->fd_next = parent->fd_next;
+
+  for(fd = FD_MIN; fd < parent->fd_cap; fd++) {
+    struct file *f = parent->fd_table[fd];
+    if(f != NULL) {
+      t->fd_table[fd] = file_reopen(f);
+      if(t->fd_table[fd] == NULL) {
+        return false;
+      }
+      file_seek(t->fd_table[fd], file_tell(f));
+    }
+  }
+  return true;
 }
 
-/* Create a new file entry, set its file and file descriptor, add it to the list
-   of file entries (fd_list), and return the file descriptor */
-void create_file_entry(struct file* open_file, int fd) {
-  /* Initialize an entry file entry */
-  struct file_entry *file_entry = malloc(sizeof(struct file_entry));
+/* Closes every file the current thread has open and frees its file
+   descriptor table.  Called when a process exits */
+void close_all_files(void) {
+  struct thread *t = thread_current();
+  int fd;
 
-  /* Set the file_entry's file */
-  file_entry->file = open_file;
+  if(t->fd_table == NULL) {
+    return;
+  }
 
-  /* Set file_entry's file descriptor */
-  file_entry->fd = fd;
+  for(fd = FD_MIN; fd < t->fd_cap; fd++) {
+    if(t->fd_table[fd] != NULL) {
+      file_close(t->fd_table[fd]);
+    }
+  }
 
-  /* Finally, add the file_entry to the list of file entries */
-  list_push_back(&thread_current()->fd_list, &file_entry->file_elem);
-}
\ No newline at end of file
+  free(t->fd_table);
+  t->fd_table = NULL;
+  t->fd_cap = 0;
+  t->fd_next = FD_MIN;
+}
@@ -6,12 +6,18 @@
 
 typedef int pid_t;
 
+struct thread;
+
 
 void syscall_init (void);
+void syscall_print_stats (void);
+void close_all_files (void);
+bool copy_file_table (struct thread *parent);
 
 void halt(void);
 void exit (int status);
 pid_t exec (const char *cmd_line);
+pid_t fork (void);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
@@ -0,0 +1,396 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every frame that holds a page from a supplemental page table
+   is on frame_list.  When the user pool runs out, a frame is
+   taken back from its pages with the clock algorithm: the hand
+   sweeps frame_list, clearing the accessed bits of the pages in
+   each frame it passes, and stops at the first frame none of
+   whose pages was accessed since the last sweep.  Its contents
+   are written to swap if they cannot be read back from a file,
+   and the frame is reused.
+
+   fork shares frames copy-on-write.  Each frame is reference
+   counted by the pages that share it, which are all mapped
+   read-only while there is more than one.  The first write to
+   a shared page faults, and frame_unshare() gives the page a
+   private copy, or, if it is the only one left, simply makes it
+   writable again.  The frame is freed along with its last page.
+
+   frame_lock guards frame_list, the clock hand, every frame,
+   and the frame and swap_slot members of every page.  It is held
+   across the disk write of an eviction, so that a process
+   faulting on a page that is being evicted waits until the page
+   is in swap before looking for it there. */
+static struct list frame_list;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+
+static struct frame *get_frame (void);
+static void attach (struct frame *, struct page *);
+static void detach (struct page *);
+static bool unshare (struct page *);
+static struct frame *choose_victim (void);
+static bool evict (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void) 
+{
+  list_init (&frame_list);
+  clock_hand = list_end (&frame_list);
+  lock_init (&frame_lock);
+}
+
+/* Obtains a frame to hold page P, evicting another page if the
+   user pool is empty.  The frame is pinned, so that it will not
+   be evicted before the caller has filled and mapped it; call
+   frame_unpin() when done.  Returns a null pointer if P already
+   has a frame or if no frame can be freed. */
+struct frame *
+frame_alloc (struct page *p) 
+{
+  struct frame *f = NULL;
+
+  lock_acquire (&frame_lock);
+  if (p->frame == NULL)
+    {
+      f = get_frame ();
+      if (f != NULL)
+        attach (f, p);
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Pins the frame that holds page P, if P is resident, so that
+   it will not be evicted until frame_unpin().  If WRITE is true,
+   the caller is going to write to the page through the returned
+   address, so P is first given a frame of its own if it shares
+   one.  Returns the frame's kernel virtual address, or a null
+   pointer if P has no frame or could not be given its own. */
+void *
+frame_pin (struct page *p, bool write)
+{
+  void *kpage = NULL;
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL && (!write || unshare (p)))
+    {
+      p->frame->pin_cnt++;
+      kpage = p->frame->kpage;
+    }
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Undoes one frame_alloc() or frame_pin() of frame F. */
+void
+frame_unpin (struct frame *f) 
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Makes DST, a page of the current process just copied from
+   page SRC of the process that is forking it, share whatever
+   holds SRC's contents: SRC's frame, which becomes read-only for
+   both, or its swap slot.  If SRC is in neither, DST will be
+   loaded from the same place as SRC when it is first touched.
+   Returns false if DST's mapping cannot be created. */
+bool
+frame_share (struct page *src, struct page *dst)
+{
+  bool success = true;
+
+  lock_acquire (&frame_lock);
+  if (src->frame != NULL)
+    {
+      struct frame *f = src->frame;
+      uint32_t *pd = src->owner->pagedir;
+
+      /* A modified page can no longer be reloaded from its file
+         once the process that modified it has its own copy. */
+      if (pagedir_is_dirty (pd, src->upage)
+          || pagedir_is_dirty (pd, f->kpage))
+        src->anonymous = true;
+      dst->anonymous = src->anonymous;
+
+      success = pagedir_set_page (dst->owner->pagedir, dst->upage,
+                                  f->kpage, false);
+      if (success)
+        {
+          pagedir_set_writable (pd, src->upage, false);
+          attach (f, dst);
+        }
+    }
+  else
+    {
+      dst->anonymous = src->anonymous;
+      if (src->swap_slot != SWAP_NONE)
+        {
+          swap_share (src->swap_slot);
+          dst->swap_slot = src->swap_slot;
+        }
+    }
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Lets page P, which must be writable, be written by its owner,
+   after a write to it faulted because it shares its frame.
+   Returns false if no frame is available for P's own copy. */
+bool
+frame_unshare (struct page *p)
+{
+  bool success = true;
+
+  ASSERT (p->writable);
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL)
+    success = unshare (p);
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Releases whatever page P holds: its place in a frame, which
+   is also unmapped from its owner's page directory and freed if
+   no other page shares it, or its hold on a swap slot. */
+void
+frame_release_page (struct page *p) 
+{
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL)
+    {
+      struct frame *f = p->frame;
+
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      detach (p);
+      if (f->ref_cnt == 0)
+        {
+          if (clock_hand == &f->elem)
+            clock_hand = list_next (clock_hand);
+          list_remove (&f->elem);
+          palloc_free_page (f->kpage);
+          free (f);
+        }
+    }
+  else if (p->swap_slot != SWAP_NONE)
+    {
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_NONE;
+    }
+  lock_release (&frame_lock);
+}
+
+/* Returns a frame with no pages, newly allocated or taken from
+   other pages, or a null pointer if no frame can be freed.  The
+   frame is pinned once.  Must be called with frame_lock held. */
+static struct frame *
+get_frame (void)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          return NULL;
+        }
+      f->kpage = kpage;
+      list_init (&f->pages);
+      f->ref_cnt = 0;
+      list_push_back (&frame_list, &f->elem);
+    }
+  else
+    {
+      /* Take a frame away from other pages, and reuse both the
+         frame and its frame table entry. */
+      f = choose_victim ();
+      if (f == NULL || !evict (f))
+        return NULL;
+    }
+  f->pin_cnt = 1;
+  return f;
+}
+
+/* Adds page P to the pages that share frame F.  Must be called
+   with frame_lock held. */
+static void
+attach (struct frame *f, struct page *p)
+{
+  list_push_back (&f->pages, &p->frame_elem);
+  f->ref_cnt++;
+  p->frame = f;
+}
+
+/* Removes page P from the pages that share its frame, without
+   freeing the frame.  Must be called with frame_lock held. */
+static void
+detach (struct page *p)
+{
+  list_remove (&p->frame_elem);
+  p->frame->ref_cnt--;
+  p->frame = NULL;
+}
+
+/* Maps page P, which must be resident, writable in its owner's
+   page directory, first copying it into a frame of its own if
+   it shares its frame.  Returns false if no frame is available.
+   Must be called with frame_lock held. */
+static bool
+unshare (struct page *p)
+{
+  struct frame *old = p->frame;
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *f;
+
+  if (old->ref_cnt == 1)
+    {
+      pagedir_set_writable (pd, p->upage, true);
+      return true;
+    }
+
+  /* Keep the shared frame from being chosen for the copy. */
+  old->pin_cnt++;
+  f = get_frame ();
+  old->pin_cnt--;
+  if (f == NULL)
+    return false;
+
+  /* Copying dirtied the new frame through its kernel address.
+     Clear that, as page_load() does. */
+  memcpy (f->kpage, old->kpage, PGSIZE);
+  pagedir_set_dirty (pd, f->kpage, false);
+
+  pagedir_clear_page (pd, p->upage);
+  detach (p);
+  attach (f, p);
+  pagedir_set_page (pd, p->upage, f->kpage, true);
+  f->pin_cnt--;
+  return true;
+}
+
+/* Chooses a frame to evict with the clock algorithm.  Returns
+   a null pointer if every frame is pinned.  Must be called with
+   frame_lock held. */
+static struct frame *
+choose_victim (void) 
+{
+  size_t i, n = list_size (&frame_list);
+
+  /* Two sweeps clear every accessed bit, so if nothing turns up
+     by then, everything is pinned. */
+  for (i = 0; i < 2 * n; i++)
+    {
+      struct frame *f;
+      struct list_elem *e;
+      bool accessed = false;
+
+      if (clock_hand == list_end (&frame_list))
+        clock_hand = list_begin (&frame_list);
+      f = list_entry (clock_hand, struct frame, elem);
+      clock_hand = list_next (clock_hand);
+
+      if (f->pin_cnt > 0)
+        continue;
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          uint32_t *pd = p->owner->pagedir;
+
+          if (pagedir_is_accessed (pd, p->upage))
+            {
+              pagedir_set_accessed (pd, p->upage, false);
+              accessed = true;
+            }
+        }
+      if (!accessed)
+        return f;
+    }
+  return NULL;
+}
+
+/* Takes frame F away from the pages that share it, writing its
+   contents to swap first unless they can be reloaded from a
+   file or are all zeros.  Every page shares the one swap slot.
+   Returns false, leaving F as it was, if swap is full.  Must be
+   called with frame_lock held. */
+static bool
+evict (struct frame *f) 
+{
+  size_t slot = SWAP_NONE;
+  bool dirty = false, anonymous = false;
+  struct list_elem *e;
+
+  /* Unmap the pages first, so that their owners fault instead
+     of changing them while they are written out.  The kernel may
+     have written the frame through its kernel address too, which
+     sets the dirty bit there instead. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      dirty = (dirty || pagedir_is_dirty (pd, p->upage)
+               || pagedir_is_dirty (pd, f->kpage));
+      anonymous = anonymous || p->anonymous;
+      pagedir_clear_page (pd, p->upage);
+    }
+
+  if (dirty || anonymous)
+    {
+      slot = swap_out (f->kpage);
+      if (slot == SWAP_NONE)
+        {
+          for (e = list_begin (&f->pages); e != list_end (&f->pages);
+               e = list_next (e))
+            {
+              struct page *p = list_entry (e, struct page, frame_elem);
+              uint32_t *pd = p->owner->pagedir;
+
+              pagedir_set_page (pd, p->upage, f->kpage,
+                                p->writable && f->ref_cnt == 1);
+              pagedir_set_dirty (pd, p->upage, dirty);
+            }
+          return false;
+        }
+    }
+
+  while (!list_empty (&f->pages))
+    {
+      struct page *p = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+
+      detach (p);
+      if (slot != SWAP_NONE)
+        {
+          /* swap_out() counted one page.  Count the others. */
+          if (f->ref_cnt > 0)
+            swap_share (slot);
+          p->swap_slot = slot;
+          p->anonymous = true;
+        }
+    }
+  return true;
+}
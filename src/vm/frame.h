@@ -0,0 +1,30 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct page;
+
+/* A physical frame from the user pool that holds a user page.
+   After a fork, the same frame holds the page for the parent
+   and every child that has not written to it yet, and is mapped
+   read-only in all of them. */
+struct frame
+  {
+    struct list_elem elem;              /* Element in frame table. */
+    void *kpage;                        /* Kernel virtual address. */
+    struct list pages;                  /* Pages that share it. */
+    unsigned ref_cnt;                   /* Number of pages in PAGES. */
+    unsigned pin_cnt;                   /* Not to be evicted if nonzero. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+void *frame_pin (struct page *, bool write);
+void frame_unpin (struct frame *);
+bool frame_share (struct page *src, struct page *dst);
+bool frame_unshare (struct page *);
+void frame_release_page (struct page *);
+
+#endif /* vm/frame.h */
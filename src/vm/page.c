@@ -0,0 +1,272 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destructor;
+
+/* Supplemental page table entries. */
+static struct slab_cache page_cache;
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void) 
+{
+  slab_cache_init (&page_cache, "page", sizeof (struct page), NULL);
+}
+
+/* Creates and returns an empty supplemental page table, or a
+   null pointer if memory allocation fails. */
+struct hash *
+page_table_create (void) 
+{
+  struct hash *pages = malloc (sizeof *pages);
+  if (pages != NULL && !hash_init (pages, page_hash, page_less, NULL)) 
+    {
+      free (pages);
+      pages = NULL;
+    }
+  return pages;
+}
+
+/* Frees supplemental page table PAGES and every entry in it,
+   along with the frames and swap slots that hold them.  Must be
+   called before the page directory is destroyed. */
+void
+page_table_destroy (struct hash *pages) 
+{
+  if (pages != NULL) 
+    {
+      hash_destroy (pages, page_destructor);
+      free (pages);
+    }
+}
+
+/* Copies every entry of supplemental page table SRC, which
+   belongs to the process that is forking the current one, into
+   the current process's table.  Each copy shares its original's
+   frame or swap slot.  Pages backed by a file are backed by
+   FILE in the copies, which must be the current process's own
+   handle on the executable, since that is the only file pages
+   come from.  Returns false if memory allocation fails. */
+bool
+page_table_copy (struct hash *src, struct file *file) 
+{
+  struct hash *pages = thread_current ()->pages;
+  struct hash_iterator i;
+
+  hash_first (&i, src);
+  while (hash_next (&i)) 
+    {
+      struct page *o = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *p = slab_alloc (&page_cache);
+
+      if (p == NULL)
+        return false;
+      p->owner = thread_current ();
+      p->upage = o->upage;
+      p->writable = o->writable;
+      p->file = o->file != NULL ? file : NULL;
+      p->file_ofs = o->file_ofs;
+      p->read_bytes = o->read_bytes;
+      p->frame = NULL;
+      p->swap_slot = SWAP_NONE;
+      hash_insert (pages, &p->hash_elem);
+      if (!frame_share (o, p))
+        return false;
+    }
+  return true;
+}
+
+/* Records that user page UPAGE of the current process is to be
+   loaded on demand with READ_BYTES bytes from FILE starting at
+   offset OFS, followed by PGSIZE - READ_BYTES zero bytes.  If
+   WRITABLE is true, the page will be writable by the user
+   process.  Returns false if UPAGE is already in the table or
+   if memory allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, bool writable) 
+{
+  struct hash *pages = thread_current ()->pages;
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = slab_alloc (&page_cache);
+  if (p == NULL)
+    return false;
+  p->owner = thread_current ();
+  p->upage = upage;
+  p->writable = writable;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->anonymous = false;
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+
+  if (hash_insert (pages, &p->hash_elem) != NULL) 
+    {
+      slab_free (&page_cache, p);
+      return false;
+    }
+  return true;
+}
+
+/* Returns the current process's page table entry for the page
+   that contains ADDR, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *addr) 
+{
+  struct hash *pages = thread_current ()->pages;
+  struct page p;
+  struct hash_elem *e;
+
+  if (pages == NULL)
+    return NULL;
+  p.upage = pg_round_down (addr);
+  e = hash_find (pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Brings the page that contains ADDR into memory, from swap if
+   it was evicted there and otherwise from its file or as zeros,
+   and maps it in the current process's page directory.  Returns
+   true if successful, false if ADDR is not in the supplemental
+   page table, the page is already present, or it could not be
+   loaded. */
+bool
+page_load (const void *addr) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (addr);
+  struct frame *f;
+  uint8_t *kpage;
+
+  if (p == NULL)
+    return false;
+  f = frame_alloc (p);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+
+  if (p->swap_slot != SWAP_NONE) 
+    {
+      swap_in (p->swap_slot, kpage);
+      p->swap_slot = SWAP_NONE;
+    }
+  else 
+    {
+      ASSERT (!p->anonymous);
+      if (p->read_bytes > 0
+          && file_read_at (p->file, kpage, p->read_bytes, p->file_ofs)
+             != (off_t) p->read_bytes)
+        goto fail;
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+    }
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    goto fail;
+
+  /* Loading the page dirtied it through its kernel address.
+     Clear that, so that eviction only sees later changes. */
+  pagedir_set_dirty (t->pagedir, kpage, false);
+  frame_unpin (f);
+  return true;
+
+ fail:
+  frame_release_page (p);
+  return false;
+}
+
+/* Handles a write to the page that contains ADDR that faulted
+   although the page is present, because it shares its frame
+   with a process forked from or by this one.  Returns true if
+   the write may be retried, false if ADDR is not in the
+   supplemental page table, the page is read-only, or no frame
+   is available for the process's own copy. */
+bool
+page_unshare (const void *addr) 
+{
+  struct page *p = page_lookup (addr);
+
+  return p != NULL && p->writable && frame_unshare (p);
+}
+
+/* Brings the page that contains ADDR into memory, if it is not
+   there already, and pins its frame so that it stays there
+   until page_unpin().  The kernel can then access the page
+   through the returned kernel virtual address, which
+   corresponds to ADDR, without faulting, even while holding
+   locks.  If WRITE is true, the kernel may write to the page
+   that way, so it must be writable and is given a frame of its
+   own if it shares one.  Returns a null pointer if ADDR is not
+   in the supplemental page table, is read-only and WRITE is
+   true, or could not be loaded. */
+void *
+page_pin (const void *addr, bool write) 
+{
+  struct page *p = page_lookup (addr);
+  uint8_t *kpage;
+
+  if (p == NULL || (write && !p->writable))
+    return NULL;
+
+  /* Another process may evict the page again between loading
+     and pinning it, so keep trying. */
+  while ((kpage = frame_pin (p, write)) == NULL)
+    if (!page_load (addr))
+      return NULL;
+  return kpage + pg_ofs (addr);
+}
+
+/* Unpins the page that contains ADDR, which must have been
+   pinned by page_pin(). */
+void
+page_unpin (const void *addr) 
+{
+  struct page *p = page_lookup (addr);
+
+  ASSERT (p != NULL && p->frame != NULL);
+  frame_unpin (p->frame);
+}
+
+/* Returns a hash value for page E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED) 
+{
+  const struct page *pa = hash_entry (a, struct page, hash_elem);
+  const struct page *pb = hash_entry (b, struct page, hash_elem);
+  return pa->upage < pb->upage;
+}
+
+/* Frees page E and whatever holds its contents. */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) 
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  frame_release_page (p);
+  slab_free (&page_cache, p);
+}
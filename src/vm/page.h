@@ -0,0 +1,57 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+
+/* A page of a process's virtual address space that is not
+   necessarily present in memory.
+
+   The supplemental page table records, for every such page,
+   where its contents come from, so that the page fault handler
+   can bring it in on first touch and again after eviction.  A
+   page whose READ_BYTES is 0 has no backing file and is filled
+   with zeros.  Once a page has been modified, it is ANONYMOUS:
+   its contents only exist in its frame or in swap.
+
+   A process created by fork starts out with a copy of each of
+   its parent's entries, which shares the parent's frame or swap
+   slot until one of them writes to it (see vm/frame.c). */
+struct page
+  {
+    struct hash_elem hash_elem;         /* Element in page table. */
+    struct thread *owner;               /* Process whose page it is. */
+    void *upage;                        /* User virtual address. */
+    bool writable;                      /* Writable by the process? */
+    struct file *file;                  /* File to load from. */
+    off_t file_ofs;                     /* Offset in FILE. */
+    uint32_t read_bytes;                /* Bytes to read; rest are zero. */
+    bool anonymous;                     /* Must be kept in swap? */
+
+    /* Owned by vm/frame.c. */
+    struct frame *frame;                /* Frame, if resident. */
+    struct list_elem frame_elem;        /* Element in frame's pages. */
+    size_t swap_slot;                   /* Swap slot, or SWAP_NONE. */
+  };
+
+void page_init (void);
+
+struct hash *page_table_create (void);
+void page_table_destroy (struct hash *);
+bool page_table_copy (struct hash *src, struct file *);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes, bool writable);
+struct page *page_lookup (const void *upage);
+bool page_load (const void *addr);
+bool page_unshare (const void *addr);
+void *page_pin (const void *addr, bool write);
+void page_unpin (const void *addr);
+
+#endif /* vm/page.h */
@@ -0,0 +1,99 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in one swap slot, which holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;   /* Swap partition, if any. */
+static struct bitmap *swap_slots;   /* One bit per slot, true if used. */
+static unsigned *slot_refs;         /* Pages that share each used slot. */
+static struct lock swap_lock;       /* Guards swap_slots and slot_refs. */
+
+/* Initializes the swap allocator.  Without a swap device, every
+   swap_out() fails. */
+void
+swap_init (void) 
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+  else
+    printf ("swap: no swap device, pages will not be swapped out\n");
+
+  /* One extra count keeps the allocation from being empty when
+     there is no swap device. */
+  swap_slots = bitmap_create (slot_cnt);
+  slot_refs = calloc (slot_cnt + 1, sizeof *slot_refs);
+  if (swap_slots == NULL || slot_refs == NULL)
+    PANIC ("swap: bitmap creation failed");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot's number, or SWAP_NONE if swap is full.  The slot starts
+   out held by one page; see swap_share(). */
+size_t
+swap_out (const void *kpage) 
+{
+  struct block_iovec iov;
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    slot_refs[slot] = 1;
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_NONE;
+
+  iov.buffer = (void *) kpage;
+  iov.cnt = SECTORS_PER_SLOT;
+  block_writev (swap_device, slot * SECTORS_PER_SLOT, &iov, 1);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and drops the
+   reading page's hold on the slot. */
+void
+swap_in (size_t slot, void *kpage) 
+{
+  struct block_iovec iov;
+
+  ASSERT (slot != SWAP_NONE);
+
+  iov.buffer = kpage;
+  iov.cnt = SECTORS_PER_SLOT;
+  block_readv (swap_device, slot * SECTORS_PER_SLOT, &iov, 1);
+  swap_free (slot);
+}
+
+/* Records that one more page, a copy made by fork, holds its
+   contents in swap slot SLOT. */
+void
+swap_share (size_t slot) 
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  slot_refs[slot]++;
+  lock_release (&swap_lock);
+}
+
+/* Drops one page's hold on swap slot SLOT without reading it,
+   and frees the slot once no page holds it. */
+void
+swap_free (size_t slot) 
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  if (--slot_refs[slot] == 0)
+    bitmap_reset (swap_slots, slot);
+  lock_release (&swap_lock);
+}
@@ -0,0 +1,17 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Slot number returned by swap_out() when swap is full, and
+   stored in pages that are not in swap. */
+#define SWAP_NONE SIZE_MAX
+
+void swap_init (void);
+size_t swap_out (const void *kpage);
+void swap_in (size_t slot, void *kpage);
+void swap_share (size_t slot);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */